@@ -24,9 +24,19 @@
 
 #import "C64Proxy.h"
 #import "C64.h"
+#import "FrameDriver.h"
 
 @interface C64Proxy(Private)
 
 - (instancetype)initWithC64:(C64 *)c64;
 
+// Routes keyboard input through the frame driver and exposes its profile
+- (void)setFrameDriver:(FrameDriver *)driver;
+
+@end
+
+@interface KeyboardProxy(Private)
+
+- (void)setFrameDriver:(FrameDriver *)driver;
+
 @end
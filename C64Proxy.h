@@ -10,6 +10,7 @@
 #import <Cocoa/Cocoa.h>
 #import <MetalKit/MetalKit.h>
 #import "C64_types.h"
+#import "FrameDriver_types.h"
 #import "basic.h"
 
 // Forward declarations of proxy classes
@@ -143,6 +144,13 @@ struct AnyC64FileWrapper;
 - (BOOL) warpLoad;
 - (void) setWarpLoad:(BOOL)b;
 
+// Profiling the frame driver
+- (BOOL) profiling;
+- (void) setProfiling:(BOOL)b;
+- (ProfileInfo) getProfileInfo;
+- (ProfileInfo) getFrameProfileInfo;
+- (void) resetProfile;
+
 // Handling snapshots
 - (BOOL) takeAutoSnapshots;
 - (void) setTakeAutoSnapshots:(BOOL)b;
@@ -568,6 +576,9 @@ struct AnyC64FileWrapper;
 - (void) powerOff;
 - (void) togglePowerSwitch;
 
+- (BOOL) bitAccuracy;
+- (void) setBitAccuracy:(BOOL)b;
+
 - (void) deleteRom;
 
 - (BOOL) redLED;
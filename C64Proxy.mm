@@ -11,12 +11,12 @@
 #import "C64Proxy+Private.h"
 #import "C64.h"
 
-struct C64Wrapper { C64 *c64; };
+struct C64Wrapper { C64 *c64; FrameDriver *driver = nullptr; };
 struct CpuWrapper { CPU *cpu; };
 struct MemoryWrapper { C64Memory *mem; };
 struct VicWrapper { VIC *vic; };
 struct CiaWrapper { CIA *cia; };
-struct KeyboardWrapper { Keyboard *keyboard; };
+struct KeyboardWrapper { Keyboard *keyboard; FrameDriver *driver = nullptr; };
 struct ControlPortWrapper { ControlPort *port; };
 struct SidBridgeWrapper { SIDBridge *sid; };
 struct IecWrapper { IEC *iec; };
@@ -723,24 +723,33 @@ struct AnyC64FileWrapper { AnyC64File *file; };
 {
     wrapper->keyboard->dump();
 }
+- (void) setFrameDriver:(FrameDriver *)driver
+{
+    wrapper->driver = driver;
+}
 - (void) pressKeyAtRow:(NSInteger)row col:(NSInteger)col
 {
-    wrapper->keyboard->pressKey(row, col);
+    if (wrapper->driver) wrapper->driver->pressKey((unsigned)row, (unsigned)col);
+    else wrapper->keyboard->pressKey(row, col);
 }
 - (void) pressRestoreKey {
-    wrapper->keyboard->pressRestoreKey();
+    if (wrapper->driver) wrapper->driver->pressRestoreKey();
+    else wrapper->keyboard->pressRestoreKey();
 }
 - (void) releaseKeyAtRow:(NSInteger)row col:(NSInteger)col
 {
-    wrapper->keyboard->releaseKey(row, col);
+    if (wrapper->driver) wrapper->driver->releaseKey((unsigned)row, (unsigned)col);
+    else wrapper->keyboard->releaseKey(row, col);
 }
 - (void) releaseRestoreKey
 {
-    wrapper->keyboard->releaseRestoreKey();
+    if (wrapper->driver) wrapper->driver->releaseRestoreKey();
+    else wrapper->keyboard->releaseRestoreKey();
 }
 - (void) releaseAll
 {
-    wrapper->keyboard->releaseAll();
+    if (wrapper->driver) wrapper->driver->releaseAllKeys();
+    else wrapper->keyboard->releaseAll();
 }
 - (BOOL) leftShiftIsPressed
 {
@@ -1125,6 +1134,14 @@ struct AnyC64FileWrapper { AnyC64File *file; };
 {
     wrapper->drive->togglePowerSwitch();
 }
+- (BOOL) bitAccuracy
+{
+    return wrapper->drive->getBitAccuracy();
+}
+- (void) setBitAccuracy:(BOOL)b
+{
+    wrapper->drive->setBitAccuracy(b);
+}
 - (void) deleteRom
 {
     wrapper->drive->mem.deleteRom();
@@ -1412,6 +1429,12 @@ struct AnyC64FileWrapper { AnyC64File *file; };
     return self;
 }
 
+- (void) setFrameDriver:(FrameDriver *)driver
+{
+    wrapper->driver = driver;
+    [keyboard setFrameDriver:driver];
+}
+
 - (void) dealloc
 {
     NSLog(@"dealloc");
@@ -1540,6 +1563,28 @@ struct AnyC64FileWrapper { AnyC64File *file; };
     wrapper->c64->setWarpLoad(b);
 }
 
+// Profiling the frame driver
+- (BOOL) profiling
+{
+    return wrapper->driver ? wrapper->driver->getProfiling() : NO;
+}
+- (void) setProfiling:(BOOL)b
+{
+    if (wrapper->driver) wrapper->driver->setProfiling(b);
+}
+- (ProfileInfo) getProfileInfo
+{
+    return wrapper->driver ? wrapper->driver->getProfileInfo() : ProfileInfo { };
+}
+- (ProfileInfo) getFrameProfileInfo
+{
+    return wrapper->driver ? wrapper->driver->getFrameProfileInfo() : ProfileInfo { };
+}
+- (void) resetProfile
+{
+    if (wrapper->driver) wrapper->driver->resetProfile();
+}
+
 // Handling snapshots
 - (BOOL) takeAutoSnapshots
 {
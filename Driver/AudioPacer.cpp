@@ -0,0 +1,112 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "AudioPacer.h"
+#include <algorithm>
+#include <cmath>
+
+// Fill levels considered close to an underflow or overflow
+static const double lowWaterMark = 0.125;
+static const double highWaterMark = 0.875;
+
+void
+AudioPacer::reset(SIDBridge &sid)
+{
+    outAccumulator = 0.0;
+    inAccumulator = 0.0;
+    ratio = 1.0;
+    underflowBase = (long)sid.bufferUnderflows;
+    overflowBase = (long)sid.bufferOverflows;
+    lowWater = 0;
+    highWater = 0;
+}
+
+size_t
+AudioPacer::read(SIDBridge &sid, double samplesPerFrame, float *out, size_t maxCount)
+{
+    // Determine the number of samples handed out in this frame
+    outAccumulator += samplesPerFrame;
+    size_t outCount = std::min((size_t)outAccumulator, maxCount);
+    outAccumulator -= outCount;
+    
+    // Read more samples if the buffer fills up and less if it runs dry
+    double fill = sid.fillLevel();
+    double deviation = fill - targetFill;
+    ratio = 1.0 + std::max(-maxAdjustment, std::min(maxAdjustment, deviation * 0.02));
+    
+    if (fill < lowWaterMark) lowWater++;
+    if (fill > highWaterMark) highWater++;
+    
+    inAccumulator += outCount * ratio;
+    size_t inCount = (size_t)inAccumulator;
+    inAccumulator -= inCount;
+    
+    if (inCount == outCount) {
+        sid.readMonoSamples(out, outCount);
+        return outCount;
+    }
+    
+    scratch.resize(inCount);
+    sid.readMonoSamples(scratch.data(), inCount);
+    resample(scratch.data(), inCount, out, outCount);
+    return outCount;
+}
+
+void
+AudioPacer::resample(const float *in, size_t inCount, float *out, size_t outCount)
+{
+    if (outCount == 0) return;
+    
+    if (inCount == 0) {
+        std::fill(out, out + outCount, 0.0f);
+        return;
+    }
+    
+    double step = (double)inCount / outCount;
+    
+    if (step >= 2.0) {
+        
+        // Decimate by averaging all input samples covered by an output sample
+        for (size_t i = 0; i < outCount; i++) {
+            
+            size_t first = (size_t)(i * step);
+            size_t last = std::min(inCount, std::max(first + 1, (size_t)((i + 1) * step)));
+            float sum = 0.0f;
+            for (size_t j = first; j < last; j++) sum += in[j];
+            out[i] = sum / (last - first);
+        }
+        
+    } else {
+        
+        // Interpolate linearly
+        for (size_t i = 0; i < outCount; i++) {
+            
+            double pos = i * step;
+            size_t j = (size_t)pos;
+            float frac = (float)(pos - j);
+            float next = j + 1 < inCount ? in[j + 1] : in[inCount - 1];
+            out[i] = in[j] + frac * (next - in[j]);
+        }
+    }
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _AUDIOPACER_INC
+#define _AUDIOPACER_INC
+
+#include "C64.h"
+#include <vector>
+
+/* Transfers the samples of a single frame from SID to the host.
+ * The host consumes sampleRate / framesPerSecond samples per frame which is
+ * not an integer. The pacer keeps the fractional part in an accumulator so
+ * that no sample is lost over time. In addition, it reads slightly more or
+ * less samples from SID than it hands out if the fill level of SID's ring
+ * buffer deviates from the target. The samples are resampled accordingly,
+ * which holds the ring buffer at its target without audible artifacts.
+ */
+class AudioPacer {
+    
+    // Fill level the ring buffer is held at
+    double targetFill = 0.5;
+    
+    // Maximum deviation of the resample ratio from 1.0
+    double maxAdjustment = 0.005;
+    
+    // Fractional parts of the output and input sample counts
+    double outAccumulator = 0.0;
+    double inAccumulator = 0.0;
+    
+    // Resample ratio (input samples per output sample) of the latest frame
+    double ratio = 1.0;
+    
+    // Samples read from SID in the latest frame
+    std::vector<float> scratch;
+    
+    // SID counters at the time of the latest reset
+    long underflowBase = 0;
+    long overflowBase = 0;
+    
+    // Number of frames in which the fill level left the tolerated range
+    long lowWater = 0;
+    long highWater = 0;
+    
+public:
+    
+    // Resets the accumulators and counters
+    void reset(SIDBridge &sid);
+    
+    /* Reads the samples of one frame from SID and writes them to 'out'.
+     * 'samplesPerFrame' is the (fractional) number of samples the host
+     * consumes per frame. Returns the number of samples written, which never
+     * exceeds 'maxCount'.
+     */
+    size_t read(SIDBridge &sid, double samplesPerFrame, float *out, size_t maxCount);
+    
+    // Converts 'inCount' samples into 'outCount' samples
+    static void resample(const float *in, size_t inCount, float *out, size_t outCount);
+    
+    
+    //
+    // Monitoring
+    //
+    
+    // Returns the resample ratio of the latest frame
+    double getRatio() const { return ratio; }
+    
+    // Returns the number of buffer underflows and overflows since the last reset
+    long underruns(const SIDBridge &sid) const { return (long)sid.bufferUnderflows - underflowBase; }
+    long overruns(const SIDBridge &sid) const { return (long)sid.bufferOverflows - overflowBase; }
+    
+    // Returns the number of frames the fill level was close to an underflow or overflow
+    long lowWaterCount() const { return lowWater; }
+    long highWaterCount() const { return highWater; }
+};
+
+#endif
@@ -0,0 +1,123 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "AudioWorker.h"
+#include "AudioPacer.h"
+#include <algorithm>
+
+AudioWorker::AudioWorker(Sink sink) : sink(sink)
+{
+    thread = std::thread(&AudioWorker::run, this);
+}
+
+AudioWorker::~AudioWorker()
+{
+    {
+        std::lock_guard<std::mutex> guard(wakeLock);
+        quit = true;
+    }
+    wakeup.notify_one();
+    thread.join();
+}
+
+float *
+AudioWorker::beginBlock(size_t capacity)
+{
+    size_t h = head.value.load(std::memory_order_relaxed);
+    
+    if (h - tail.value.load(std::memory_order_acquire) == queueSize) {
+        dropped++;
+        return nullptr;
+    }
+    
+    Block &block = blocks[h % queueSize];
+    if (block.samples.size() < capacity) block.samples.resize(capacity);
+    return block.samples.data();
+}
+
+void
+AudioWorker::commitBlock(size_t count, unsigned oversampling, unsigned warpFactor,
+                         FirDecimator::Kernel kernel)
+{
+    size_t h = head.value.load(std::memory_order_relaxed);
+    Block &block = blocks[h % queueSize];
+    
+    block.count = count;
+    block.oversampling = oversampling;
+    block.warpFactor = warpFactor;
+    block.kernel = kernel;
+    head.value.store(h + 1, std::memory_order_release);
+    
+    // Taking the lock makes sure the worker doesn't miss the notification
+    { std::lock_guard<std::mutex> guard(wakeLock); }
+    wakeup.notify_one();
+}
+
+void
+AudioWorker::run()
+{
+    while (true) {
+        
+        {
+            std::unique_lock<std::mutex> guard(wakeLock);
+            wakeup.wait(guard, [this] {
+                return quit || tail.value.load(std::memory_order_relaxed) != head.value.load(std::memory_order_acquire);
+            });
+            if (quit) return;
+        }
+        
+        // Process all available blocks without locking
+        size_t t = tail.value.load(std::memory_order_relaxed);
+        while (t != head.value.load(std::memory_order_acquire)) {
+            
+            process(blocks[t % queueSize]);
+            tail.value.store(++t, std::memory_order_release);
+        }
+    }
+}
+
+void
+AudioWorker::process(Block &block)
+{
+    if (decimator.getKernel() != block.kernel) decimator.setKernel(block.kernel);
+    if (decimator.getFactor() != block.oversampling) decimator.configure(block.oversampling);
+    
+    float *samples = block.samples.data();
+    size_t count = decimator.process(samples, block.count, samples, block.count);
+    
+    if (block.warpFactor > 1) {
+        
+        // Decimate to the length of a single frame
+        size_t total = count + warpRemainder;
+        size_t outCount = total / block.warpFactor;
+        warpRemainder = total % block.warpFactor;
+        
+        output.resize(outCount);
+        AudioPacer::resample(samples, count, output.data(), outCount);
+        samples = output.data();
+        count = outCount;
+    }
+    
+    if (count) sink(samples, count);
+}
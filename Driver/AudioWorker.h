@@ -0,0 +1,118 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _AUDIOWORKER_INC
+#define _AUDIOWORKER_INC
+
+#include "FirDecimator.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Post-processes SID output on a separate thread.
+ * The emulation thread copies the samples of a frame out of SID's ring
+ * buffer into a block and hands the block over through a single-producer,
+ * single-consumer queue. The worker decimates oversampled blocks, folds the
+ * frames of a warped block into a single frame, and passes the result to
+ * the sink. Blocks are handed over by publishing an index; the only lock
+ * is taken to wake the worker up. If the worker falls behind by more than
+ * the queue size, the block is dropped.
+ */
+class AudioWorker {
+    
+public:
+    
+    // Receives the processed samples on the worker thread
+    typedef std::function<void(const float *samples, size_t count)> Sink;
+    
+private:
+    
+    struct Block {
+        std::vector<float> samples;
+        size_t count;
+        unsigned oversampling;
+        unsigned warpFactor;
+        FirDecimator::Kernel kernel;
+    };
+    
+    // Number of blocks in the queue
+    static const size_t queueSize = 8;
+    Block blocks[queueSize];
+    
+    // A counter padded to the size of a cache line (keeps head and tail on separate lines)
+    struct Index {
+        std::atomic<size_t> value { 0 };
+        char padding[64 - sizeof(std::atomic<size_t>)];
+    };
+    
+    // Number of blocks written (by the producer) and read (by the worker)
+    Index head;
+    Index tail;
+    
+    // Wakes the worker up when a block arrives or the worker shall quit
+    std::mutex wakeLock;
+    std::condition_variable wakeup;
+    bool quit = false;
+    
+    // State of the worker
+    FirDecimator decimator;
+    size_t warpRemainder = 0;
+    std::vector<float> output;
+    Sink sink;
+    
+    // Number of blocks dropped because the queue was full
+    std::atomic<long> dropped { 0 };
+    
+    std::thread thread;
+    
+public:
+    
+    explicit AudioWorker(Sink sink);
+    ~AudioWorker();
+    
+    /* Returns a block buffer holding at least 'capacity' samples.
+     * Returns NULL if the queue is full. Call from the emulation thread only.
+     */
+    float *beginBlock(size_t capacity);
+    
+    /* Publishes the block returned by beginBlock().
+     * The block holds 'count' samples at 'oversampling' times the host rate,
+     * produced by 'warpFactor' emulated frames. The worker filters it with
+     * the given convolution kernel.
+     */
+    void commitBlock(size_t count, unsigned oversampling, unsigned warpFactor,
+                     FirDecimator::Kernel kernel);
+    
+    long droppedBlocks() const { return dropped.load(); }
+    
+private:
+    
+    void run();
+    void process(Block &block);
+};
+
+#endif
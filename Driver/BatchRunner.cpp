@@ -0,0 +1,150 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "BatchRunner.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+BatchRunner::BatchRunner(unsigned threads)
+{
+    threadCount = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+FrameDriver &
+BatchRunner::addInstance()
+{
+    drivers.emplace_back(new FrameDriver());
+    return *drivers.back();
+}
+
+BatchStats
+BatchRunner::run(uint64_t frames)
+{
+    size_t count = drivers.size();
+    unsigned threads = (unsigned)std::max((size_t)1, std::min((size_t)threadCount, count));
+    
+    std::vector<Worker> workers(threads);
+    std::vector<uint64_t> remaining(count, frames);
+    std::vector<uint64_t> startCycles(count);
+    std::atomic<size_t> unfinished(count);
+    std::atomic<size_t> queued(0);
+    std::atomic<uint64_t> steals(0);
+    
+    // Idle workers wait here for new slices
+    std::mutex idleLock;
+    std::condition_variable idle;
+    unsigned sleeping = 0;
+    
+    // Distribute the instances round robin
+    for (size_t i = 0; i < count; i++) {
+        startCycles[i] = drivers[i]->c64->cpu.cycle;
+        if (frames) workers[i % threads].slices.push_back(i);
+    }
+    queued = frames ? count : 0;
+    if (!frames) unfinished = 0;
+    
+    auto wake = [&](bool all) {
+        
+        // Taking the lock makes sure a worker about to sleep sees the change
+        std::lock_guard<std::mutex> guard(idleLock);
+        if (sleeping) { if (all) idle.notify_all(); else idle.notify_one(); }
+    };
+    
+    auto work = [&](unsigned id) {
+        
+        Worker &own = workers[id];
+        
+        while (unfinished > 0) {
+            
+            size_t nr = SIZE_MAX;
+            
+            // Take the most recent slice from the own queue
+            {
+                std::lock_guard<std::mutex> guard(own.lock);
+                if (!own.slices.empty()) {
+                    nr = own.slices.back();
+                    own.slices.pop_back();
+                    queued--;
+                }
+            }
+            
+            // Steal the oldest slice from another queue
+            for (unsigned i = 1; nr == SIZE_MAX && i < threads; i++) {
+                
+                Worker &victim = workers[(id + i) % threads];
+                std::lock_guard<std::mutex> guard(victim.lock);
+                if (!victim.slices.empty()) {
+                    nr = victim.slices.front();
+                    victim.slices.pop_front();
+                    queued--;
+                    steals++;
+                }
+            }
+            
+            // Sleep until another worker queues a slice or all are done
+            if (nr == SIZE_MAX) {
+                
+                std::unique_lock<std::mutex> guard(idleLock);
+                sleeping++;
+                idle.wait(guard, [&] { return queued > 0 || unfinished == 0; });
+                sleeping--;
+                continue;
+            }
+            
+            // Run the slice
+            uint64_t n = std::min((uint64_t)sliceFrames, remaining[nr]);
+            for (uint64_t i = 0; i < n; i++) drivers[nr]->executeFrame();
+            remaining[nr] -= n;
+            
+            if (remaining[nr]) {
+                {
+                    std::lock_guard<std::mutex> guard(own.lock);
+                    own.slices.push_back(nr);
+                    queued++;
+                }
+                wake(false);
+            } else if (--unfinished == 0) {
+                wake(true);
+            }
+        }
+    };
+    
+    auto start = std::chrono::steady_clock::now();
+    
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; i++) pool.emplace_back(work, i);
+    work(0);
+    for (auto &thread : pool) thread.join();
+    
+    BatchStats stats = { };
+    stats.instances = count;
+    stats.threads = threads;
+    stats.frames = frames * count;
+    stats.steals = steals;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (size_t i = 0; i < count; i++) stats.cycles += drivers[i]->c64->cpu.cycle - startCycles[i];
+    
+    return stats;
+}
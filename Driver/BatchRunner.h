@@ -0,0 +1,87 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _BATCHRUNNER_INC
+#define _BATCHRUNNER_INC
+
+#include "FrameDriver.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+typedef struct
+{
+    size_t instances;     // Number of emulator instances
+    unsigned threads;     // Number of worker threads
+    uint64_t frames;      // Frames emulated by all instances
+    uint64_t cycles;      // CPU cycles emulated by all instances
+    uint64_t steals;      // Number of slices taken from another worker's queue
+    double seconds;       // Wall clock time
+}
+BatchStats;
+
+/* Runs many emulator instances in parallel.
+ * Each instance is an independent FrameDriver. The work is cut into slices
+ * of a few frames per instance. Every worker thread owns a queue of slices,
+ * works through it from the back, and steals from the front of other queues
+ * once it runs dry. An instance is never stepped by two threads at the same
+ * time, because each instance has at most one slice in all queues. Workers
+ * that find all queues empty sleep until a slice is queued again.
+ */
+class BatchRunner {
+    
+    struct Worker {
+        std::mutex lock;
+        std::deque<size_t> slices;
+    };
+    
+    // Emulator instances
+    std::vector<std::unique_ptr<FrameDriver>> drivers;
+    
+    // Number of worker threads
+    unsigned threadCount;
+    
+    // Number of frames emulated in a single slice
+    unsigned sliceFrames = 25;
+    
+public:
+    
+    // Creates a runner with the given number of threads (0 = one per core)
+    explicit BatchRunner(unsigned threads = 0);
+    
+    // Creates a new instance (instances are created one after another)
+    FrameDriver &addInstance();
+    
+    size_t instanceCount() const { return drivers.size(); }
+    FrameDriver &instance(size_t nr) { return *drivers[nr]; }
+    
+    unsigned getThreadCount() const { return threadCount; }
+    void setSliceFrames(unsigned frames) { sliceFrames = frames ? frames : 1; }
+    
+    // Emulates the given number of frames in every instance
+    BatchStats run(uint64_t frames);
+};
+
+#endif
@@ -0,0 +1,99 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "DiskCache.h"
+#include "MappedFile.h"
+#include <cstdio>
+#include <cstring>
+
+// Hashes a buffer 8 bytes at a time
+static uint64_t
+hashBytes(const uint8_t *data, size_t size, uint64_t h)
+{
+    size_t i = 0;
+    
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        h = (h ^ word) * 0x100000001b3;
+        h ^= h >> 29;
+    }
+    for (; i < size; i++) {
+        h = (h ^ data[i]) * 0x100000001b3;
+    }
+    return h;
+}
+
+std::string
+DiskCache::key(const uint8_t *image, size_t size)
+{
+    char key[80];
+    
+    // Two independent 64-bit hashes make collisions practically impossible
+    snprintf(key, sizeof(key), "%016llx%016llx-%zu-v%d.%d.%d",
+             (unsigned long long)hashBytes(image, size, 0xcbf29ce484222325),
+             (unsigned long long)hashBytes(image, size, 0x84222325cbf29ce4),
+             size, V_MAJOR, V_MINOR, V_SUBMINOR);
+    return key;
+}
+
+std::string
+DiskCache::path(const std::string &key) const
+{
+    return directory + "/disk-" + key + ".g64";
+}
+
+G64File *
+DiskCache::lookup(const std::string &key)
+{
+    MappedFile file(path(key).c_str());
+    
+    if (file.isOpen() && G64File::isG64Buffer(file.data(), file.size())) {
+        
+        G64File *g64 = G64File::makeWithBuffer(file.data(), file.size());
+        if (g64) {
+            hits++;
+            return g64;
+        }
+    }
+    
+    misses++;
+    return nullptr;
+}
+
+bool
+DiskCache::store(const std::string &key, Disk *disk)
+{
+    G64File *g64 = G64File::makeWithDisk(disk);
+    if (g64 == nullptr) return false;
+    
+    std::string target = path(key);
+    std::string tmp = target + ".tmp";
+    
+    bool result = g64->writeToFile(tmp.c_str()) && rename(tmp.c_str(), target.c_str()) == 0;
+    if (!result) remove(tmp.c_str());
+    
+    delete g64;
+    return result;
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _DISKCACHE_INC
+#define _DISKCACHE_INC
+
+#include "C64.h"
+#include <string>
+
+/* Cache of encoded disks, shared by all launches.
+ * Inserting a D64 image (or a T64 or PRG file) makes the 1541 GCR-encode
+ * every track. The cache stores the result as a G64 image, whose halftracks
+ * are inserted without any encoding. Entries are keyed by a hash of the
+ * image bytes and the emulator version, so renamed or copied images hit the
+ * same entry and an updated encoder never sees stale data. Files are
+ * written under a temporary name and renamed, so concurrent launches never
+ * read a partial entry.
+ */
+class DiskCache {
+    
+    // Directory holding the entries (empty if the cache is disabled)
+    std::string directory;
+    
+    // Number of lookups that found an entry or didn't
+    long hits = 0;
+    long misses = 0;
+    
+public:
+    
+    const std::string &getDirectory() const { return directory; }
+    void setDirectory(const std::string &dir) { directory = dir; }
+    bool isEnabled() const { return !directory.empty(); }
+    
+    // Computes the key of an image
+    static std::string key(const uint8_t *image, size_t size);
+    
+    // Returns the path of the entry for a key
+    std::string path(const std::string &key) const;
+    
+    // Returns the cached encoding of an image or NULL if there is none
+    G64File *lookup(const std::string &key);
+    
+    // Writes the encoding of the disk in a drive to the cache
+    bool store(const std::string &key, Disk *disk);
+    
+    long getHits() const { return hits; }
+    long getMisses() const { return misses; }
+};
+
+#endif
@@ -0,0 +1,355 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "FastDrive.h"
+#include <algorithm>
+#include <cstdio>
+
+// Kernal vectors and the routines they point to after a reset
+static const uint16_t openVector = 0x031A;
+static const uint16_t loadVector = 0x0330;
+static const uint16_t saveVector = 0x0332;
+static const uint16_t openRoutine = 0xF34A;
+static const uint16_t loadRoutine = 0xF4A5;
+static const uint16_t saveRoutine = 0xF5ED;
+
+// Hooks in unused RAM. Calls to device 8 spin until the driver answers them,
+// calls to other devices continue in the Kernal right away.
+static const uint16_t hookArea = 0x02D8;
+static const uint16_t saveHook = 0x02D8;
+static const uint16_t saveSpin = 0x02E1;
+static const uint16_t openHook = 0x02E4;
+static const uint16_t openSpin = 0x02ED;
+static const uint16_t loadHook = 0x02F0;
+static const uint16_t loadSpin = 0x02FB;
+static const uint8_t hookCode[] = {
+    0xA5, 0xBA,         // $02D8: LDA $BA   (SAVE)
+    0xC9, 0x08,         // $02DA: CMP #$08
+    0xF0, 0x03,         // $02DC: BEQ $02E1
+    0x4C, 0xED, 0xF5,   // $02DE: JMP $F5ED
+    0x4C, 0xE1, 0x02,   // $02E1: JMP $02E1
+    0xA5, 0xBA,         // $02E4: LDA $BA   (OPEN)
+    0xC9, 0x08,         // $02E6: CMP #$08
+    0xF0, 0x03,         // $02E8: BEQ $02ED
+    0x4C, 0x4A, 0xF3,   // $02EA: JMP $F34A
+    0x4C, 0xED, 0x02,   // $02ED: JMP $02ED
+    0x85, 0x93,         // $02F0: STA $93   (LOAD, stores the verify flag like $F4A5)
+    0xA5, 0xBA,         // $02F2: LDA $BA
+    0xC9, 0x08,         // $02F4: CMP #$08
+    0xF0, 0x03,         // $02F6: BEQ $02FB
+    0x4C, 0xA7, 0xF4,   // $02F8: JMP $F4A7
+    0x4C, 0xFB, 0x02    // $02FB: JMP $02FB
+};
+
+// Kernal code used to return from LOAD
+static const uint16_t loadContinue = 0xF4A7;    // LOAD after storing the verify flag
+static const uint16_t loadDone = 0xF5A9;        // CLC, LDX $AE, LDY $AF, RTS
+static const uint16_t fileNotFound = 0xF704;    // I/O error #4
+static const uint16_t missingFileName = 0xF710; // I/O error #8
+
+// Number of blocks on an empty disk
+static const unsigned blocksPerDisk = 664;
+
+static inline uint16_t
+peek16(C64Memory &mem, uint16_t addr)
+{
+    return mem.spypeek(addr) | mem.spypeek(addr + 1) << 8;
+}
+
+static inline void
+poke16(C64Memory &mem, uint16_t addr, uint16_t value)
+{
+    mem.poke(addr, value & 0xFF);
+    mem.poke(addr + 1, value >> 8);
+}
+
+// Maps a character to the unshifted PETSCII letters used in file names
+static inline uint8_t
+normalize(uint8_t c)
+{
+    if (c >= 'a' && c <= 'z') return c - 'a' + 'A';
+    if (c >= 0xC1 && c <= 0xDA) return c - 0x80;
+    return c;
+}
+
+static std::string
+normalize(const char *name)
+{
+    std::string result;
+    for (; name && *name; name++) result.push_back((char)normalize((uint8_t)*name));
+    return result;
+}
+
+// Matches a file name against a pattern with wildcards
+static bool
+matches(const uint8_t *pattern, size_t length, const std::string &name)
+{
+    for (size_t i = 0; i < length; i++) {
+        
+        if (pattern[i] == '*') return true;
+        if (i >= name.size()) return false;
+        if (pattern[i] != '?' && normalize(pattern[i]) != (uint8_t)name[i]) return false;
+    }
+    return length == name.size();
+}
+
+bool
+FastDrive::insert(AnyArchive *archive)
+{
+    std::vector<File> list;
+    
+    for (int i = 0; i < archive->numberOfItems(); i++) {
+        
+        archive->selectItem(i);
+        
+        File file;
+        file.name = normalize(archive->getNameOfItem());
+        file.type = archive->getTypeOfItemAsString();
+        file.address = archive->getDestinationAddrOfItem();
+        file.data.reserve(archive->getSizeOfItem());
+        
+        archive->seekItem(0);
+        for (int byte; (byte = archive->readItem()) != EOF; ) {
+            file.data.push_back((uint8_t)byte);
+        }
+        list.push_back(file);
+    }
+    
+    if (list.empty()) return false;
+    
+    eject();
+    this->archive = archive;
+    diskName = normalize(archive->getName());
+    files.swap(list);
+    return true;
+}
+
+void
+FastDrive::eject()
+{
+    delete archive;
+    archive = nullptr;
+    diskName.clear();
+    files.clear();
+}
+
+AnyArchive *
+FastDrive::takeArchive()
+{
+    AnyArchive *result = archive;
+    
+    archive = nullptr;
+    eject();
+    return result;
+}
+
+const FastDrive::File *
+FastDrive::find(const uint8_t *name, size_t length) const
+{
+    // Skip the drive prefix (e.g. "0:" or "@0:")
+    const uint8_t *colon = std::find(name, name + length, ':');
+    if (colon != name + length) {
+        length -= colon + 1 - name;
+        name = colon + 1;
+    }
+    
+    for (const File &file : files) {
+        if (matches(name, length, file.name)) return &file;
+    }
+    return nullptr;
+}
+
+std::vector<uint8_t>
+FastDrive::directory(uint16_t address) const
+{
+    std::vector<uint8_t> prg;
+    unsigned used = 0;
+    
+    auto addLine = [&](unsigned number, const std::string &text) {
+        
+        size_t start = prg.size();
+        prg.insert(prg.end(), { 0, 0, (uint8_t)(number & 0xFF), (uint8_t)(number >> 8) });
+        prg.insert(prg.end(), text.begin(), text.end());
+        prg.push_back(0);
+        
+        // Link to the next line
+        uint16_t next = (uint16_t)(address + prg.size());
+        prg[start] = next & 0xFF;
+        prg[start + 1] = next >> 8;
+    };
+    
+    std::string header = diskName.substr(0, 16);
+    header.resize(16, ' ');
+    addLine(0, "\x12\"" + header + "\" 00 2A");
+    
+    for (const File &file : files) {
+        
+        unsigned blocks = (unsigned)((file.data.size() + 2 + 253) / 254);
+        std::string text(blocks < 10 ? 3 : blocks < 100 ? 2 : 1, ' ');
+        
+        text += "\"" + file.name + "\"";
+        text.resize(text.size() + 16 - std::min(file.name.size(), (size_t)16), ' ');
+        text += " " + file.type;
+        
+        addLine(blocks, text);
+        used += blocks;
+    }
+    
+    addLine(used < blocksPerDisk ? blocksPerDisk - used : 0, "BLOCKS FREE.");
+    prg.push_back(0);
+    prg.push_back(0);
+    return prg;
+}
+
+void
+FastDrive::installHooks(C64 *c64)
+{
+    C64Memory &mem = c64->mem;
+    
+    // Leave the vectors alone if a program has changed them
+    if (peek16(mem, openVector) != openRoutine ||
+        peek16(mem, loadVector) != loadRoutine ||
+        peek16(mem, saveVector) != saveRoutine) return;
+    
+    for (uint16_t i = 0; i < sizeof(hookCode); i++) mem.poke(hookArea + i, hookCode[i]);
+    
+    poke16(mem, openVector, openHook);
+    poke16(mem, loadVector, loadHook);
+    poke16(mem, saveVector, saveHook);
+}
+
+void
+FastDrive::removeHooks(C64 *c64)
+{
+    C64Memory &mem = c64->mem;
+    
+    if (peek16(mem, openVector) == openHook) poke16(mem, openVector, openRoutine);
+    if (peek16(mem, loadVector) == loadHook) poke16(mem, loadVector, loadRoutine);
+    if (peek16(mem, saveVector) == saveHook) poke16(mem, saveVector, saveRoutine);
+}
+
+bool
+FastDrive::hooksInstalled(C64 *c64) const
+{
+    C64Memory &mem = c64->mem;
+    
+    return (peek16(mem, openVector) == openHook &&
+            peek16(mem, loadVector) == loadHook &&
+            peek16(mem, saveVector) == saveHook);
+}
+
+bool
+FastDrive::hooksDamaged(C64 *c64) const
+{
+    C64Memory &mem = c64->mem;
+    
+    if (peek16(mem, openVector) != openHook &&
+        peek16(mem, loadVector) != loadHook &&
+        peek16(mem, saveVector) != saveHook) return false;
+    
+    for (uint16_t i = 0; i < sizeof(hookCode); i++) {
+        if (mem.spypeek(hookArea + i) != hookCode[i]) return true;
+    }
+    return false;
+}
+
+FastDrive::Request
+FastDrive::serve(C64 *c64, bool answerLoad)
+{
+    C64Memory &mem = c64->mem;
+    uint16_t pc = c64->cpu.getPC();
+    
+    if (pc != saveSpin && pc != openSpin && pc != loadSpin) return REQUEST_NONE;
+    if (hooksDamaged(c64)) return REQUEST_NONE;
+    
+    // Make sure the CPU spins in a hook and not in some other program
+    if (mem.spypeek(pc) != 0x4C || peek16(mem, pc + 1) != pc) return REQUEST_NONE;
+    
+    // Only calls to device 8 get here
+    switch (pc) {
+            
+        case saveSpin: continuation = saveRoutine; break;
+        case openSpin: continuation = openRoutine; break;
+            
+        default:
+            continuation = loadContinue;
+            if (answerLoad && mem.spypeek(0x93) == 0) return load(c64);
+            break;
+    }
+    return REQUEST_FALLBACK;
+}
+
+void
+FastDrive::resume(C64 *c64)
+{
+    c64->cpu.jumpToAddress(continuation);
+}
+
+FastDrive::Request
+FastDrive::load(C64 *c64)
+{
+    C64Memory &mem = c64->mem;
+    
+    uint8_t name[256];
+    size_t length = mem.spypeek(0xB7);
+    uint16_t pointer = peek16(mem, 0xBB);
+    for (size_t i = 0; i < length; i++) name[i] = mem.spypeek((uint16_t)(pointer + i));
+    
+    if (length == 0) {
+        c64->cpu.jumpToAddress(missingFileName);
+        return REQUEST_SERVED;
+    }
+    
+    // Secondary address 0 loads to the address passed to LOAD
+    bool relocate = mem.spypeek(0xB9) == 0;
+    uint16_t start = peek16(mem, 0xC3);
+    std::vector<uint8_t> listing;
+    const std::vector<uint8_t> *data;
+    
+    if (name[0] == '$') {
+        
+        if (!relocate) start = 0x0401;
+        listing = directory(start);
+        data = &listing;
+        
+    } else {
+        
+        const File *file = find(name, length);
+        if (file == nullptr) {
+            c64->cpu.jumpToAddress(fileNotFound);
+            return REQUEST_SERVED;
+        }
+        if (!relocate) start = file->address;
+        data = &file->data;
+    }
+    
+    uint16_t end = start;
+    for (uint8_t byte : *data) mem.poke(end++, byte);
+    
+    // Leave the machine as the Kernal does after loading
+    poke16(mem, 0xAE, end);
+    mem.poke(0x90, 0x40);
+    c64->cpu.jumpToAddress(loadDone);
+    return REQUEST_SERVED;
+}
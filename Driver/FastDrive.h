@@ -0,0 +1,137 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _FASTDRIVE_INC
+#define _FASTDRIVE_INC
+
+#include "C64.h"
+#include <string>
+#include <vector>
+
+/* High-level emulation of drive 8.
+ * Instead of emulating the 1541 and its GCR bit stream, the files of a disk
+ * are kept in memory and Kernal calls are answered directly. The Kernal
+ * vectors of LOAD, OPEN and SAVE are redirected to small hooks in unused
+ * RAM ($02D8 - $02FD). Calls to other devices pass straight through to the
+ * Kernal. Calls to device 8 spin in a loop, and when the CPU is found in one
+ * of these loops at the end of a frame, LOAD is served from the file list,
+ * including the directory ("$"). OPEN and SAVE to device 8, as used to send
+ * drive commands like M-W and M-E, can't be answered without a drive. The
+ * caller is asked to hand the disk to the emulated 1541 and to continue the
+ * original Kernal routine. Programs that call LISTEN, SECOND or CIOUT
+ * directly never pass the vectors and have to be caught by the caller.
+ */
+class FastDrive {
+    
+public:
+    
+    struct File {
+        std::string name;
+        std::string type;
+        uint16_t address;
+        std::vector<uint8_t> data;
+    };
+    
+    enum Request {
+        REQUEST_NONE,     // The CPU doesn't wait in a hook
+        REQUEST_SERVED,   // The call has been answered
+        REQUEST_FALLBACK  // The call must be answered by the emulated drive
+    };
+    
+private:
+    
+    // The inserted disk (owned by this object)
+    AnyArchive *archive = nullptr;
+    
+    // Name of the disk and the files it contains
+    std::string diskName;
+    std::vector<File> files;
+    
+    // Address of the Kernal routine to continue after a fallback
+    uint16_t continuation = 0;
+    
+public:
+    
+    ~FastDrive() { eject(); }
+    
+    /* Takes the files of an archive.
+     * The drive takes ownership of the archive. Returns false and leaves the
+     * archive to the caller if it doesn't contain any files, e.g., if it is a
+     * G64 image.
+     */
+    bool insert(AnyArchive *archive);
+    
+    // Deletes the disk
+    void eject();
+    
+    // Hands the disk over to the caller and empties the drive
+    AnyArchive *takeArchive();
+    
+    bool hasDisk() const { return archive != nullptr; }
+    const std::vector<File> &getFiles() const { return files; }
+    
+    /* Looks up a file by name.
+     * The name is given in PETSCII and may contain the wildcards '*' and '?'
+     * and a drive prefix like "0:". Returns NULL if no file matches.
+     */
+    const File *find(const uint8_t *name, size_t length) const;
+    
+    // Builds the directory listing as a BASIC program located at 'address'
+    std::vector<uint8_t> directory(uint16_t address) const;
+    
+    
+    //
+    // Hooking the Kernal
+    //
+    
+    // Redirects the Kernal vectors if they point to their default routines
+    void installHooks(C64 *c64);
+    
+    // Restores the Kernal vectors that still point to the hooks
+    void removeHooks(C64 *c64);
+    
+    /* Answers a Kernal call to device 8 if the CPU waits in a hook.
+     * If 'answerLoad' is false, LOAD is left to the emulated drive like OPEN
+     * and SAVE. Nothing is served while the hooks are damaged. The hooks
+     * return into the stock Kernal (901227-03), so the caller must not
+     * install them with any other Kernal.
+     */
+    Request serve(C64 *c64, bool answerLoad = true);
+    
+    // Checks if the Kernal vectors point to the hooks
+    bool hooksInstalled(C64 *c64) const;
+    
+    // Checks if a vector points to a hook that a program has overwritten
+    bool hooksDamaged(C64 *c64) const;
+    
+    // Resumes the original Kernal routine after a fallback
+    void resume(C64 *c64);
+    
+private:
+    
+    // Serves LOAD from the file list
+    Request load(C64 *c64);
+};
+
+#endif
@@ -0,0 +1,250 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "FirDecimator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FIR_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+#define FIR_NEON
+#include <arm_neon.h>
+#endif
+
+// Number of filter taps per decimation phase
+static const unsigned tapsPerPhase = 16;
+
+static float
+dotScalar(const float *a, const float *b, size_t n)
+{
+    // Four accumulators give the compiler some freedom to reorder
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    
+    for (size_t i = 0; i < n; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+#ifdef FIR_X86
+
+static float
+dotSSE2(const float *a, const float *b, size_t n)
+{
+    __m128 s0 = _mm_setzero_ps();
+    __m128 s1 = _mm_setzero_ps();
+    
+    for (size_t i = 0; i < n; i += 8) {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(s0, s1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+__attribute__((target("avx2,fma"))) static float
+dotAVX2(const float *a, const float *b, size_t n)
+{
+    __m256 s = _mm256_setzero_ps();
+    
+    for (size_t i = 0; i < n; i += 8) {
+        s = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s);
+    }
+    
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+    float lanes[4];
+    _mm_storeu_ps(lanes, sum);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+#endif
+
+#ifdef FIR_NEON
+
+static float
+dotNEON(const float *a, const float *b, size_t n)
+{
+    float32x4_t s0 = vdupq_n_f32(0.0f);
+    float32x4_t s1 = vdupq_n_f32(0.0f);
+    
+    for (size_t i = 0; i < n; i += 8) {
+        s0 = vmlaq_f32(s0, vld1q_f32(a + i), vld1q_f32(b + i));
+        s1 = vmlaq_f32(s1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    
+    float lanes[4];
+    vst1q_f32(lanes, vaddq_f32(s0, s1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+#endif
+
+FirDecimator::FirDecimator()
+{
+    setKernel(bestKernel());
+}
+
+bool
+FirDecimator::isSupported(Kernel kernel)
+{
+    switch (kernel) {
+            
+        case KERNEL_SCALAR:
+            return true;
+            
+#ifdef FIR_X86
+        case KERNEL_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+            
+#ifdef FIR_NEON
+        case KERNEL_NEON:
+            return true;
+#endif
+            
+        default:
+            return false;
+    }
+}
+
+FirDecimator::Kernel
+FirDecimator::bestKernel()
+{
+    if (isSupported(KERNEL_AVX2)) return KERNEL_AVX2;
+    if (isSupported(KERNEL_NEON)) return KERNEL_NEON;
+    if (isSupported(KERNEL_SSE2)) return KERNEL_SSE2;
+    return KERNEL_SCALAR;
+}
+
+const char *
+FirDecimator::kernelName(Kernel kernel)
+{
+    switch (kernel) {
+        case KERNEL_SCALAR: return "scalar";
+        case KERNEL_SSE2: return "SSE2";
+        case KERNEL_AVX2: return "AVX2";
+        case KERNEL_NEON: return "NEON";
+    }
+    return "?";
+}
+
+bool
+FirDecimator::setKernel(Kernel kernel)
+{
+    if (!isSupported(kernel)) return false;
+    
+    switch (kernel) {
+            
+#ifdef FIR_X86
+        case KERNEL_SSE2: dot = dotSSE2; break;
+        case KERNEL_AVX2: dot = dotAVX2; break;
+#endif
+#ifdef FIR_NEON
+        case KERNEL_NEON: dot = dotNEON; break;
+#endif
+        default: dot = dotScalar; break;
+    }
+    this->kernel = kernel;
+    return true;
+}
+
+void
+FirDecimator::configure(unsigned factor)
+{
+    this->factor = std::max(factor, 1u);
+    taps.clear();
+    
+    if (this->factor > 1) {
+        
+        // Blackman windowed sinc with its cutoff at 90% of the output band
+        size_t count = tapsPerPhase * this->factor;
+        double cutoff = 0.45 / this->factor;
+        double center = (count - 1) / 2.0;
+        double sum = 0.0;
+        
+        taps.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            
+            double x = i - center;
+            double sinc = x == 0.0 ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * x) / (M_PI * x);
+            double window = 0.42 - 0.5 * cos(2.0 * M_PI * i / (count - 1)) + 0.08 * cos(4.0 * M_PI * i / (count - 1));
+            taps[i] = (float)(sinc * window);
+            sum += taps[i];
+        }
+        
+        // Normalize to unity gain and reverse for the convolution
+        for (float &tap : taps) tap = (float)(tap / sum);
+        std::reverse(taps.begin(), taps.end());
+    }
+    
+    reset();
+}
+
+void
+FirDecimator::reset()
+{
+    work.assign(taps.empty() ? 0 : taps.size() - 1, 0.0f);
+    skip = factor;
+}
+
+size_t
+FirDecimator::process(const float *in, size_t count, float *out, size_t maxCount)
+{
+    if (factor == 1) {
+        
+        count = std::min(count, maxCount);
+        if (out != in) memmove(out, in, count * sizeof(float));
+        return count;
+    }
+    
+    // Append the input to the history, so 'out' may overwrite 'in'
+    size_t history = taps.size() - 1;
+    work.resize(history + count);
+    memcpy(work.data() + history, in, count * sizeof(float));
+    
+    // Compute every factor-th output. Input i ends the window at work[i].
+    size_t written = 0;
+    size_t i = skip - 1;
+    for (; i < count && written < maxCount; i += factor) {
+        out[written++] = dot(work.data() + i, taps.data(), taps.size());
+    }
+    skip = (unsigned)(i >= count ? i - count + 1 : 1);
+    
+    // Keep the latest inputs for the next call
+    memmove(work.data(), work.data() + count, history * sizeof(float));
+    work.resize(history);
+    return written;
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _FIRDECIMATOR_INC
+#define _FIRDECIMATOR_INC
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Low-pass filter and decimator for oversampled SID output.
+ * Letting reSID sample at a multiple of the host rate with SID_SAMPLE_FAST
+ * and decimating the result with a windowed-sinc FIR filter removes the
+ * aliasing of the fast sampling method at a fraction of the cost of reSID's
+ * own resampling, which convolves at the full clock rate. Only every n-th
+ * output of the filter is computed. The convolution runs on SSE2, AVX2 or
+ * NEON, depending on what the host CPU supports.
+ */
+class FirDecimator {
+    
+public:
+    
+    enum Kernel {
+        KERNEL_SCALAR = 0,
+        KERNEL_SSE2,
+        KERNEL_AVX2,
+        KERNEL_NEON
+    };
+    
+private:
+    
+    // Ratio of input and output sample rate
+    unsigned factor = 1;
+    
+    // Filter coefficients in reverse order (a multiple of 8)
+    std::vector<float> taps;
+    
+    // The latest taps.size() - 1 input samples followed by the current input
+    std::vector<float> work;
+    
+    // Number of input samples to read before the next output sample
+    unsigned skip = 1;
+    
+    // Computes the dot product of two vectors of n floats (n is a multiple of 8)
+    float (*dot)(const float *a, const float *b, size_t n);
+    Kernel kernel;
+    
+public:
+    
+    FirDecimator();
+    
+    /* Selects the decimation factor.
+     * The filter has 16 taps per output phase and passes 90% of the output
+     * band. A factor of 1 disables filtering.
+     */
+    void configure(unsigned factor);
+    unsigned getFactor() const { return factor; }
+    
+    // Clears the filter history
+    void reset();
+    
+    /* Filters 'count' samples and writes the decimated samples to 'out'.
+     * Returns the number of samples written, which never exceeds 'maxCount'.
+     * 'in' and 'out' may point to the same buffer.
+     */
+    size_t process(const float *in, size_t count, float *out, size_t maxCount);
+    
+    
+    //
+    // Selecting the convolution kernel
+    //
+    
+    static bool isSupported(Kernel kernel);
+    static Kernel bestKernel();
+    static const char *kernelName(Kernel kernel);
+    
+    Kernel getKernel() const { return kernel; }
+    bool setKernel(Kernel kernel);
+};
+
+#endif
@@ -0,0 +1,1547 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "FrameDriver.h"
+#include "RomRegistry.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <unistd.h>
+
+// ROM images searched by loadRoms()
+static const char *basicRomName = "basic.901226-01.bin";
+static const char *kernalRomName = "kernal.901227-03.bin";
+static const char *jiffyKernalRomName = "JiffyDOS_C64.bin";
+static const char *charRomName = "characters.901225-01.bin";
+static const char *vc1541RomName = "1541-II.355640-01.bin";
+static const char *jiffyVC1541RomName = "JiffyDOS_C1541.bin";
+
+// Kernal loop polling the keyboard buffer (LDA $C6 / STA $CC / STA $0292 / BEQ)
+static const uint16_t inputLoopFirst = 0xE5CD;
+static const uint16_t inputLoopLast = 0xE5D4;
+
+// Kernal keyboard buffer, number of buffered keys, and buffer size
+static const uint16_t keydAddr = 0x0277;
+static const uint16_t ndxAddr = 0x00C6;
+static const uint16_t xmaxAddr = 0x0289;
+
+// Start of BASIC memory and the BASIC pointers adjusted by LOAD
+static const uint16_t basicStart = 0x0801;
+static const uint16_t basicPointers[] = {
+    0x2D, // VARTAB (start of variables)
+    0x2F, // ARYTAB (start of arrays)
+    0x31, // STREND (end of arrays)
+    0xAE  // EAL (end address of the last load)
+};
+
+// Header preceding the state written by saveState()
+struct StateHeader {
+    char magic[4];
+    uint8_t major;
+    uint8_t minor;
+    uint8_t subminor;
+    uint8_t reserved;
+    uint64_t size;
+};
+static const char stateMagic[4] = { 'V', 'C', 'S', 'T' };
+
+// Running further ahead risks an overflow of SID's ring buffer
+static const unsigned maxRunAheadFrames = 4;
+
+// Oversampling fills SID's ring buffer faster, which limits running ahead, too
+static const unsigned maxOversampling = 4;
+
+// Serializes the creation and deletion of emulator instances. reSID builds its
+// waveform and filter tables in static storage when the first instance is
+// created. Everything else in an instance is private to that instance.
+static std::mutex instanceLock;
+
+// Number of frames drive 1 needs to be idle before it is switched off
+static const unsigned driveIdleThreshold = 100;
+
+// Upper bound for the number of samples SID produces in a single frame
+static const size_t maxSamplesPerFrame = 2048;
+
+// Mixes a value into a 64-bit hash
+static inline uint64_t
+hashMix(uint64_t h, uint64_t value)
+{
+    h ^= value + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2);
+    return h;
+}
+
+// Returns the time passed since 'start' in nanoseconds
+static inline uint64_t
+nanosecondsSince(std::chrono::steady_clock::time_point start)
+{
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+// Adds the host time spent in a scope to a profiling counter
+class ProfileTimer {
+    
+    uint64_t *counter;
+    std::chrono::steady_clock::time_point start;
+    
+public:
+    
+    ProfileTimer(bool enabled, uint64_t &counter) : counter(enabled ? &counter : nullptr) {
+        if (enabled) start = std::chrono::steady_clock::now();
+    }
+    ~ProfileTimer() {
+        if (counter) *counter += nanosecondsSince(start);
+    }
+};
+
+// Translates an ASCII character into the code the Kernal reads from the keyboard
+static inline uint8_t
+petscii(char c)
+{
+    if (c >= 'a' && c <= 'z') return (uint8_t)(c - 'a' + 'A');
+    if (c == '\n' || c == '\r') return 0x0D;
+    if (c >= 0x20 && c <= 0x5D) return (uint8_t)c;
+    return 0;
+}
+
+// Hashes a single line of the emulator texture
+static inline uint64_t
+hashLine(const uint32_t *pixels, unsigned width)
+{
+    const uint64_t *p = (const uint64_t *)pixels;
+    uint64_t h = 0xcbf29ce484222325;
+    
+    for (unsigned i = 0; i < width / 2; i++) {
+        h = (h ^ p[i]) * 0x100000001b3;
+        h ^= h >> 29;
+    }
+    if (width & 1) {
+        h = (h ^ pixels[width - 1]) * 0x100000001b3;
+    }
+    return h;
+}
+
+FrameDriver::FrameDriver()
+{
+    std::lock_guard<std::mutex> guard(instanceLock);
+    c64 = new C64();
+    audioBuffer.resize(maxSamplesPerFrame);
+    hostRate = c64->sid.getSampleRate();
+}
+
+FrameDriver::~FrameDriver()
+{
+    std::lock_guard<std::mutex> guard(instanceLock);
+    delete pendingDisk;
+    delete c64;
+}
+
+void
+FrameDriver::configure(VICModel model)
+{
+    // System
+    c64->vic.setModel(model);
+    
+    // Peripherals
+    c64->setAlwaysWarp(false);
+    c64->setWarpLoad(false); // Warping is done by the driver to keep audio in sync
+    c64->drive1.setSendSoundMessages(false);
+    
+    // Audio
+    c64->sid.setReSID(true);
+    c64->sid.setModel(MOS_6581); // MOS6581 or MOS8580
+    c64->sid.setSamplingMethod(SID_SAMPLE_FAST);
+    c64->sid.setAudioFilter(false);
+}
+
+bool
+FrameDriver::loadRoms(const std::string &dir, bool jiffyDOS, std::string *failedRom)
+{
+    // The files are read once per process (see RomRegistry)
+    RomRegistry &registry = RomRegistry::shared();
+    auto lookup = [&](const char *name) { return registry.get(dir + "/" + name); };
+    auto isType = [](const std::shared_ptr<const RomRegistry::Image> &image, C64FileType type) {
+        return image && image->file.getFileType() == type;
+    };
+    
+    auto basic = lookup(basicRomName);
+    auto stock = lookup(kernalRomName);
+    auto kernal = jiffyDOS ? lookup(jiffyKernalRomName) : nullptr;
+    auto chars = lookup(charRomName);
+    auto vc1541 = lookup(jiffyVC1541RomName);
+    
+    if (!isType(kernal, KERNAL_ROM_FILE)) kernal = stock;
+    if (!isType(vc1541, VC1541_ROM_FILE)) vc1541 = lookup(vc1541RomName);
+    
+    const char *failed = nullptr;
+    if (!isType(basic, BASIC_ROM_FILE)) failed = basicRomName;
+    else if (!isType(kernal, KERNAL_ROM_FILE)) failed = kernalRomName;
+    else if (!isType(chars, CHAR_ROM_FILE)) failed = charRomName;
+    else if (!isType(vc1541, VC1541_ROM_FILE)) failed = vc1541RomName;
+    
+    if (failed) {
+        if (failedRom) *failedRom = dir + "/" + failed;
+        return false;
+    }
+    
+    // Skip the images this instance already holds
+    if (basic->fingerprint == c64->mem.basicRomFingerprint()) basic = nullptr;
+    if (kernal->fingerprint == c64->mem.kernalRomFingerprint()) kernal = nullptr;
+    if (chars->fingerprint == c64->mem.characterRomFingerprint()) chars = nullptr;
+    if (vc1541->fingerprint == c64->drive1.mem.romFingerprint()) vc1541 = nullptr;
+    
+    // Flashing copies the image into this instance
+    for (auto &image : { basic, kernal, chars, vc1541 }) {
+        if (image == nullptr) continue;
+        ROMFile *rom = image->file.makeRom();
+        if (rom) c64->flash(rom);
+        delete rom;
+    }
+    
+    stockKernal = isType(stock, KERNAL_ROM_FILE) && c64->mem.kernalRomFingerprint() == stock->fingerprint;
+    return true;
+}
+
+MediaType
+FrameDriver::mediaTypeOfFile(const char *path)
+{
+    return MediaFile(path).getMediaType();
+}
+
+bool
+FrameDriver::attachCartridge(const MediaFile &file)
+{
+    CRTFile *crt = file.makeCartridge();
+    if (crt == nullptr) return false;
+    
+    c64->expansionport.attachCartridgeAndReset(crt);
+    delete crt;
+    
+    recordEvent(INPUT_CARTRIDGE, 0, 0, file.getPath());
+    return true;
+}
+
+bool
+FrameDriver::insertTape(const MediaFile &file)
+{
+    TAPFile *tap = file.makeTape();
+    if (tap == nullptr) return false;
+    
+    bool result = c64->datasette.insertTape(tap);
+    delete tap;
+    
+    if (result) recordEvent(INPUT_TAPE, 0, 0, file.getPath());
+    return result;
+}
+
+bool
+FrameDriver::insertDisk(const MediaFile &file)
+{
+    AnyArchive *archive = file.makeArchive();
+    if (archive == nullptr) return false;
+    
+    setDiskKey(archive, file);
+    insertArchive(archive);
+    
+    recordEvent(INPUT_DISK, 0, 0, file.getPath());
+    return true;
+}
+
+bool
+FrameDriver::autostart(const MediaFile &file)
+{
+    AnyArchive *archive = file.makeArchive();
+    if (archive == nullptr) return false;
+    
+    // Look for the program to start
+    int item = -1, programs = 0;
+    for (int i = 0; i < archive->numberOfItems(); i++) {
+        
+        archive->selectItem(i);
+        if (strcmp(archive->getTypeOfItemAsString(), "PRG") != 0) continue;
+        if (programs++ == 0) item = i;
+    }
+    
+    // Multi-load titles are loaded by the drive
+    if (programs != 1) { delete archive; return false; }
+    
+    archive->selectItem(item);
+    uint32_t start = archive->getDestinationAddrOfItem();
+    uint32_t end = start + (uint32_t)archive->getSizeOfItem();
+    
+    // Programs with a different load address can't be started with RUN
+    if (start != basicStart || end <= start || end > 0xFFFF) {
+        delete archive;
+        return false;
+    }
+    
+    if (!c64->flash(archive, item)) { delete archive; return false; }
+    
+    if (archive->type() == D64_FILE) {
+        setDiskKey(archive, file);
+        insertArchive(archive);
+    } else {
+        delete archive;
+    }
+    
+    for (uint16_t addr : basicPointers) {
+        c64->mem.poke(addr, end & 0xFF);
+        c64->mem.poke(addr + 1, end >> 8);
+    }
+    
+    queueText("run\n", 0, nullptr);
+    
+    recordEvent(INPUT_AUTOSTART, 0, 0, file.getPath());
+    return true;
+}
+
+bool
+FrameDriver::attachMedia(const MediaFile &file)
+{
+    switch (file.getMediaType()) {
+            
+        case MEDIA_CARTRIDGE: return attachCartridge(file);
+        case MEDIA_TAPE: return insertTape(file);
+        case MEDIA_ARCHIVE: return insertDisk(file);
+        default: return false;
+    }
+}
+
+void
+FrameDriver::powerUp()
+{
+    c64->sid.run();
+    c64->cpu.clearErrorState();
+    c64->drive1.cpu.clearErrorState();
+    c64->drive2.cpu.clearErrorState();
+    c64->restartTimer();
+    pacer.reset(c64->sid);
+    decimator.reset();
+    rewindBuffer.clear();
+    cancelTyping();
+    frame = 0;
+    
+    // The idle state depends on the drive ROM
+    driveIdleState.clear();
+    driveIdleFrames = 0;
+}
+
+uint64_t
+FrameDriver::bootKey() const
+{
+    uint64_t key = 0;
+    
+    key = hashMix(key, c64->mem.basicRomFingerprint());
+    key = hashMix(key, c64->mem.kernalRomFingerprint());
+    key = hashMix(key, c64->mem.characterRomFingerprint());
+    key = hashMix(key, c64->drive1.mem.romFingerprint());
+    key = hashMix(key, (uint64_t)c64->vic.getModel());
+    key = hashMix(key, (uint64_t)c64->sid.getModel());
+    key = hashMix(key, (uint64_t)drivePowerSaving);
+    return key;
+}
+
+std::string
+FrameDriver::bootSnapshotPath(const std::string &dir) const
+{
+    char name[32];
+    
+    snprintf(name, sizeof(name), "boot-%016llx.vc64", (unsigned long long)bootKey());
+    return dir + "/" + name;
+}
+
+bool
+FrameDriver::saveBootSnapshot(const std::string &dir)
+{
+    std::string path = bootSnapshotPath(dir);
+    std::string tmp = path + ".tmp";
+    
+    // Keep the snapshot usable without the idle state of the drive
+    wakeDrive();
+    driveIdleFrames = 0;
+    
+    // Write to a temporary file first to never expose a partial snapshot
+    bool result = saveStateToFile(tmp.c_str()) && rename(tmp.c_str(), path.c_str()) == 0;
+    if (!result) remove(tmp.c_str());
+    
+    return result;
+}
+
+bool
+FrameDriver::restoreBootSnapshot(const std::string &dir)
+{
+    return loadStateFromFile(bootSnapshotPath(dir).c_str());
+}
+
+size_t
+FrameDriver::stateSize() const
+{
+    return sizeof(StateHeader) + c64->stateSize();
+}
+
+size_t
+FrameDriver::saveState(uint8_t *buffer, size_t capacity)
+{
+    auto start = std::chrono::steady_clock::now();
+    
+    if (capacity < stateSize()) return 0;
+    
+    c64->suspend();
+    uint8_t *ptr = buffer + sizeof(StateHeader);
+    c64->saveToBuffer(&ptr);
+    c64->resume();
+    
+    StateHeader header = {
+        { stateMagic[0], stateMagic[1], stateMagic[2], stateMagic[3] },
+        V_MAJOR, V_MINOR, V_SUBMINOR, 0,
+        (uint64_t)(ptr - buffer) - sizeof(StateHeader)
+    };
+    memcpy(buffer, &header, sizeof(header));
+    
+    saveInfo.bytes = ptr - buffer;
+    saveInfo.nanoseconds = nanosecondsSince(start);
+    return saveInfo.bytes;
+}
+
+bool
+FrameDriver::loadState(const uint8_t *buffer, size_t size)
+{
+    auto start = std::chrono::steady_clock::now();
+    StateHeader header;
+    
+    if (size < sizeof(header)) return false;
+    memcpy(&header, buffer, sizeof(header));
+    
+    if (memcmp(header.magic, stateMagic, sizeof(stateMagic)) != 0 ||
+        header.major != V_MAJOR || header.minor != V_MINOR || header.subminor != V_SUBMINOR ||
+        header.size > size - sizeof(header)) return false;
+    
+    // A state replacing the one loaded last makes the frames between moot
+    if (recording && !recording->events.empty() && recording->events.back().type == INPUT_STATE) {
+        recording->events.pop_back();
+    }
+    recordEvent(INPUT_STATE, 0, 0, std::string((const char *)buffer, sizeof(header) + header.size));
+    
+    resetDrivePower();
+    
+    c64->suspend();
+    uint8_t *ptr = (uint8_t *)buffer + sizeof(header);
+    c64->loadFromBuffer(&ptr);
+    c64->keyboard.releaseAll();
+    c64->ping();
+    c64->resume();
+    
+    // The state may come from a session with other audio settings
+    bool fast = oversampling == 1 || c64->sid.getSamplingMethod() == SID_SAMPLE_FAST;
+    if (c64->sid.getSampleRate() != hostRate * oversampling || !fast) applyAudioConfig();
+    
+    loadInfo.bytes = sizeof(header) + header.size;
+    loadInfo.nanoseconds = nanosecondsSince(start);
+    return true;
+}
+
+bool
+FrameDriver::saveState(int fd)
+{
+    stateBuffer.resize(stateSize());
+    
+    size_t size = saveState(stateBuffer.data(), stateBuffer.size());
+    const uint8_t *ptr = stateBuffer.data();
+    
+    while (size > 0) {
+        
+        ssize_t written = write(fd, ptr, size);
+        if (written <= 0) return false;
+        ptr += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool
+FrameDriver::saveStateToFile(const char *path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    
+    bool result = saveState(fd);
+    return close(fd) == 0 && result;
+}
+
+bool
+FrameDriver::loadState(int fd)
+{
+    auto start = std::chrono::steady_clock::now();
+    size_t size = 0;
+    
+    // Read the whole file into the scratch buffer
+    for (ssize_t count = 1; count > 0; size += count) {
+        
+        if (stateBuffer.size() < size + 65536) stateBuffer.resize(size + 65536);
+        count = read(fd, stateBuffer.data() + size, stateBuffer.size() - size);
+        if (count < 0) return false;
+    }
+    
+    if (loadState(stateBuffer.data(), size)) return true;
+    
+    // Fall back to the snapshot format used by older versions
+    Snapshot *snapshot = Snapshot::makeWithBuffer(stateBuffer.data(), size);
+    if (snapshot == nullptr) return false;
+    
+    c64->loadFromSnapshotSafe(snapshot);
+    delete snapshot;
+    
+    loadInfo.bytes = size;
+    loadInfo.nanoseconds = nanosecondsSince(start);
+    return true;
+}
+
+bool
+FrameDriver::loadStateFromFile(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    
+    bool result = loadState(fd);
+    close(fd);
+    return result;
+}
+
+void
+FrameDriver::executeFrame()
+{
+    double samplesPerFrame = c64->sid.getSampleRate() / c64->vic.getFramesPerSecond();
+    
+    bool warp = alwaysWarp || (warpLoad && isLoading());
+    
+    // Fade in to hide the discontinuity when returning to normal speed
+    if (warping && !warp) c64->sid.rampUpFromZero();
+    warping = warp;
+    
+    presentRunAhead = false;
+    
+    uint64_t startFrame = frame;
+    uint64_t cpuCycle = c64->cpu.cycle;
+    uint64_t drive1Cycle = c64->drive1.cpu.cycle;
+    uint64_t drive2Cycle = c64->drive2.cpu.cycle;
+    if (profiling) frameProfile = { };
+    
+    if (!warp) {
+        
+        runFrame();
+        {
+            ProfileTimer timer(profiling, frameProfile.audioNanos);
+            if (audioWorker) {
+                
+                // Leave the filtering to the audio thread
+                size_t capacity = audioBuffer.size() * oversampling;
+                float *block = audioWorker->beginBlock(capacity);
+                if (block == nullptr) {
+                    oversampleBuffer.resize(capacity);
+                    block = oversampleBuffer.data();
+                }
+                size_t count = pacer.read(c64->sid, samplesPerFrame, block, capacity);
+                if (block != oversampleBuffer.data()) audioWorker->commitBlock(count, oversampling, 1, decimator.getKernel());
+                audioCount = 0;
+                
+            } else if (oversampling > 1) {
+                
+                float *target = audioTarget(audioBuffer.size());
+                size_t count = pacer.read(c64->sid, samplesPerFrame,
+                                          oversampleBuffer.data(), oversampleBuffer.size());
+                audioCount = decimator.process(oversampleBuffer.data(), count,
+                                               target, audioBuffer.size());
+                publishAudio(target);
+                
+            } else {
+                
+                float *target = audioTarget(audioBuffer.size());
+                audioCount = pacer.read(c64->sid, samplesPerFrame, target, audioBuffer.size());
+                publishAudio(target);
+            }
+        }
+        if (runAheadFrames) {
+            ProfileTimer timer(profiling, frameProfile.runAheadNanos);
+            runAhead();
+        }
+        
+    } else {
+        
+        // Emulate several frames and keep all samples
+        size_t count = 0;
+        size_t capacity = audioBuffer.size() * warpFactor * oversampling;
+        float *block = audioWorker ? audioWorker->beginBlock(capacity) : nullptr;
+        float *target = block;
+        if (target == nullptr) {
+            warpBuffer.resize(capacity);
+            target = warpBuffer.data();
+        }
+        for (unsigned i = 0; i < warpFactor; i++) {
+            
+            runFrame();
+            ProfileTimer timer(profiling, frameProfile.audioNanos);
+            count += pacer.read(c64->sid, samplesPerFrame, target + count, capacity - count);
+        }
+        
+        // Decimate to the length of a single frame
+        ProfileTimer timer(profiling, frameProfile.audioNanos);
+        if (audioWorker) {
+            
+            if (block) audioWorker->commitBlock(count, oversampling, warpFactor, decimator.getKernel());
+            audioCount = 0;
+            
+        } else {
+            
+            count = decimator.process(target, count, target, capacity);
+            size_t total = count + warpRemainder;
+            audioCount = std::min(total / warpFactor, audioBuffer.size());
+            warpRemainder = total % warpFactor;
+            float *output = audioTarget(audioCount);
+            AudioPacer::resample(target, count, output, audioCount);
+            publishAudio(output);
+        }
+    }
+    
+    if (drivePowerSaving) manageDrivePower();
+    
+    if (trackDirtyLines) {
+        ProfileTimer timer(profiling, frameProfile.videoNanos);
+        updateDirtyLines();
+    }
+    if (indexedOutput) {
+        ProfileTimer timer(profiling, frameProfile.videoNanos);
+        packFrame();
+    }
+    if (recordRewind) {
+        ProfileTimer timer(profiling, frameProfile.rewindNanos);
+        recordState();
+    }
+    
+    if (profiling) {
+        
+        frameProfile.frames = frame - startFrame;
+        frameProfile.cpuCycles = c64->cpu.cycle - cpuCycle;
+        frameProfile.drive1Cycles = c64->drive1.cpu.cycle - drive1Cycle;
+        frameProfile.drive2Cycles = c64->drive2.cpu.cycle - drive2Cycle;
+        frameProfile.audioSamples = audioCount;
+        
+        profile.frames += frameProfile.frames;
+        profile.cpuCycles += frameProfile.cpuCycles;
+        profile.drive1Cycles += frameProfile.drive1Cycles;
+        profile.drive2Cycles += frameProfile.drive2Cycles;
+        profile.audioSamples += frameProfile.audioSamples;
+        profile.emulationNanos += frameProfile.emulationNanos;
+        profile.inputNanos += frameProfile.inputNanos;
+        profile.audioNanos += frameProfile.audioNanos;
+        profile.videoNanos += frameProfile.videoNanos;
+        profile.rewindNanos += frameProfile.rewindNanos;
+        profile.runAheadNanos += frameProfile.runAheadNanos;
+    }
+}
+
+void
+FrameDriver::runFrame()
+{
+    {
+        ProfileTimer timer(profiling, frameProfile.inputNanos);
+        applyInput();
+        if (typing) feedKeyboardBuffer();
+    }
+    {
+        ProfileTimer timer(profiling, frameProfile.emulationNanos);
+        c64->executeOneFrame();
+        frame++;
+    }
+    
+    ProfileTimer timer(profiling, frameProfile.inputNanos);
+    if (!traps.empty()) checkTraps();
+    if (fastDrive.hasDisk()) serveFastDrive();
+    if (pendingDisk) servePendingDisk();
+    
+    // Verify the replay once all recorded frames have been emulated
+    if (replaying && frame - movieFrame == replaying->frames) {
+        replayMatched = stateHash() == replaying->finalHash;
+        replaying = nullptr;
+    }
+}
+
+bool
+FrameDriver::isLoading() const
+{
+    return c64->drive1.isRotating() || c64->datasette.getMotor();
+}
+
+void
+FrameDriver::setDrivePowerSaving(bool value)
+{
+    drivePowerSaving = value;
+    driveIdleFrames = 0;
+    
+    if (!value) {
+        wakeDrive();
+        if (!c64->drive2.isPoweredOn()) c64->drive2.powerOn();
+    }
+}
+
+void
+FrameDriver::setDriveMode(DriveMode mode)
+{
+    if (mode != DRIVE_HIGH_LEVEL) handOverDisk();
+    
+    driveMode = mode;
+    c64->drive1.setBitAccuracy(mode != DRIVE_FAST);
+}
+
+void
+FrameDriver::insertArchive(AnyArchive *archive)
+{
+    // The hooks of the high-level drive return into the stock Kernal
+    if (driveMode == DRIVE_HIGH_LEVEL && stockKernal && fastDrive.insert(archive)) {
+        
+        delete pendingDisk;
+        pendingDisk = nullptr;
+        
+        // The 1541 is switched off once it is idle without a disk
+        if (c64->drive1.hasDisk()) {
+            c64->drive1.prepareToEject();
+            c64->drive1.ejectDisk();
+        }
+        return;
+    }
+    
+    fastDrive.removeHooks(c64);
+    fastDrive.eject();
+    
+    if (lazyDiskInsert) {
+        deferInsert(archive);
+        return;
+    }
+    insertIntoDrive(archive);
+}
+
+void
+FrameDriver::deferInsert(AnyArchive *archive)
+{
+    // The 1541 sees the old disk leave right away and the new one later
+    if (c64->drive1.hasDisk()) {
+        c64->drive1.prepareToEject();
+        c64->drive1.ejectDisk();
+    }
+    delete pendingDisk;
+    pendingDisk = archive;
+}
+
+void
+FrameDriver::servePendingDisk()
+{
+    // Without working hooks, the disk can't wait for the first access
+    if (!stockKernal || fastDrive.hooksDamaged(c64)) {
+        AnyArchive *archive = pendingDisk;
+        pendingDisk = nullptr;
+        fastDrive.removeHooks(c64);
+        insertIntoDrive(archive);
+        return;
+    }
+    
+    fastDrive.installHooks(c64);
+    
+    // Wait for a Kernal call to drive 8 unless the drive is accessed directly
+    FastDrive::Request request = fastDrive.serve(c64, false);
+    if (request != FastDrive::REQUEST_FALLBACK &&
+        fastDrive.hooksInstalled(c64) && !c64->drive1.isRotating()) return;
+    
+    AnyArchive *archive = pendingDisk;
+    pendingDisk = nullptr;
+    fastDrive.removeHooks(c64);
+    insertIntoDrive(archive);
+    
+    if (request == FastDrive::REQUEST_FALLBACK) fastDrive.resume(c64);
+}
+
+void
+FrameDriver::setLazyDiskInsert(bool value)
+{
+    lazyDiskInsert = value;
+    
+    if (!value && pendingDisk) {
+        AnyArchive *archive = pendingDisk;
+        pendingDisk = nullptr;
+        fastDrive.removeHooks(c64);
+        insertIntoDrive(archive);
+    }
+}
+
+void
+FrameDriver::insertIntoDrive(AnyArchive *archive)
+{
+    std::string key;
+    key.swap(diskKey);
+    
+    // Skip the encoding if the cache has done it before
+    if (!key.empty()) {
+        if (G64File *g64 = diskCache.lookup(key)) {
+            delete archive;
+            archive = g64;
+            key.clear();
+        }
+    }
+    
+    wakeDrive();
+    c64->drive1.prepareToInsert();
+    c64->drive1.insertDisk(archive);
+    delete archive;
+    
+    if (!key.empty()) diskCache.store(key, &c64->drive1.disk);
+}
+
+void
+FrameDriver::setDiskKey(AnyArchive *archive, const MediaFile &file)
+{
+    // G64 images are inserted without encoding
+    bool encoded = archive->type() == G64_FILE;
+    
+    if (diskCache.isEnabled() && !encoded) {
+        diskKey = DiskCache::key(file.data(), file.size());
+    } else {
+        diskKey.clear();
+    }
+}
+
+void
+FrameDriver::handOverDisk()
+{
+    if (!fastDrive.hasDisk()) return;
+    
+    fastDrive.removeHooks(c64);
+    insertIntoDrive(fastDrive.takeArchive());
+}
+
+void
+FrameDriver::serveFastDrive()
+{
+    // Let the 1541 take over if the Kernal changed or a program overwrote the hooks
+    if (!stockKernal || fastDrive.hooksDamaged(c64)) {
+        handOverDisk();
+        return;
+    }
+    
+    fastDrive.installHooks(c64);
+    
+    if (fastDrive.serve(c64) == FastDrive::REQUEST_FALLBACK) {
+        
+        // Let the cycle exact 1541 answer
+        handOverDisk();
+        fastDrive.resume(c64);
+        return;
+    }
+    
+    // A program talking to drive 8 without the Kernal vectors spins it up
+    if (c64->drive1.isRotating()) handOverDisk();
+}
+
+void
+FrameDriver::manageDrivePower()
+{
+    VC1541 &drive = c64->drive1;
+    
+    if (c64->drive2.isPoweredOn()) c64->drive2.powerOff();
+    if (!drive.isPoweredOn()) return;
+    
+    // Wait until the drive has finished its reset routine and sits in ROM
+    bool idle = !drive.hasDisk() && !pendingDisk && !drive.isRotating() && drive.cpu.getPC() >= 0xC000;
+    driveIdleFrames = idle ? driveIdleFrames + 1 : 0;
+    if (driveIdleFrames < driveIdleThreshold) return;
+    
+    driveIdleState.resize(drive.stateSize());
+    uint8_t *ptr = driveIdleState.data();
+    drive.saveToBuffer(&ptr);
+    drive.powerOff();
+}
+
+void
+FrameDriver::resetDrivePower()
+{
+    wakeDrive();
+    driveIdleState.clear();
+    
+    if (drivePowerSaving) {
+        if (c64->drive2.isPoweredOn()) c64->drive2.powerOff();
+    } else {
+        if (!c64->drive2.isPoweredOn()) c64->drive2.powerOn();
+    }
+}
+
+void
+FrameDriver::wakeDrive()
+{
+    VC1541 &drive = c64->drive1;
+    
+    driveIdleFrames = 0;
+    if (drive.isPoweredOn()) return;
+    
+    drive.powerOn();
+    
+    // Without a saved state, the drive runs its reset routine
+    if (!driveIdleState.empty()) {
+        uint8_t *ptr = driveIdleState.data();
+        drive.loadFromBuffer(&ptr);
+    }
+}
+
+void
+FrameDriver::setExternalFrameBuffers(uint32_t *const *buffers, unsigned count)
+{
+    externalBuffers.assign(buffers, buffers + count);
+    bufferHashes.assign(count, std::vector<uint64_t>());
+    bufferHashesValid.assign(count, false);
+    backBuffer = 0;
+    frontBuffer = nullptr;
+}
+
+uint32_t *
+FrameDriver::swapFrameBuffers()
+{
+    if (externalBuffers.empty()) return nullptr;
+    
+    uint32_t *target = externalBuffers[backBuffer];
+    unsigned width = frameWidth();
+    unsigned height = frameHeight();
+    uint64_t nanos = 0;
+    
+    // Expand the indexed frame if it is up to date
+    uint32_t palette[16];
+    bool expand = indexedOutput && indexedFrame.getHeight() == height;
+    if (expand) getPalette(palette);
+    
+    auto copyLines = [&](unsigned y, unsigned count) {
+        if (expand) {
+            indexedFrame.expandLines(target, y, count, palette);
+        } else {
+            memcpy(target + y * width, frameBuffer() + y * width, count * width * sizeof(uint32_t));
+        }
+    };
+    
+    if (trackDirtyLines && lineHashes.size() == height) {
+        
+        // Copy the lines that differ from what the buffer already contains
+        ProfileTimer timer(profiling, nanos);
+        std::vector<uint64_t> &hashes = bufferHashes[backBuffer];
+        bool valid = bufferHashesValid[backBuffer];
+        
+        for (unsigned y = 0; y < height; y++) {
+            if (!valid || hashes[y] != lineHashes[y]) copyLines(y, 1);
+        }
+        hashes = lineHashes;
+        bufferHashesValid[backBuffer] = true;
+        
+    } else {
+        
+        ProfileTimer timer(profiling, nanos);
+        copyLines(0, height);
+        bufferHashesValid[backBuffer] = false;
+    }
+    
+    frameProfile.videoNanos += nanos;
+    profile.videoNanos += nanos;
+    
+    frontBuffer = target;
+    backBuffer = (backBuffer + 1) % externalBuffers.size();
+    return frontBuffer;
+}
+
+void
+FrameDriver::setIndexedOutput(bool value)
+{
+    indexedOutput = value;
+    indexedFrame.resize(0, 0);
+    if (value) packFrame();
+}
+
+void
+FrameDriver::getPalette(uint32_t palette[16]) const
+{
+    for (unsigned i = 0; i < 16; i++) palette[i] = c64->vic.getColor(i);
+}
+
+void
+FrameDriver::packFrame()
+{
+    unsigned width = frameWidth();
+    unsigned height = frameHeight();
+    uint32_t palette[16];
+    getPalette(palette);
+    
+    // Start over if the texture size has changed
+    if (indexedFrame.getWidth() != width || indexedFrame.getHeight() != height) {
+        indexedFrame.resize(width, height);
+        indexedFrame.pack(frameBuffer(), palette);
+        return;
+    }
+    
+    if (!trackDirtyLines || lineHashes.size() != height) {
+        indexedFrame.pack(frameBuffer(), palette);
+        return;
+    }
+    
+    for (unsigned y = 0; y < height; y++) {
+        if (lineIsDirty(y)) indexedFrame.packLines(frameBuffer(), y, 1, palette);
+    }
+}
+
+void
+FrameDriver::setDirtyTracking(bool value)
+{
+    trackDirtyLines = value;
+    lineHashes.clear();
+    bufferHashesValid.assign(externalBuffers.size(), false);
+}
+
+bool
+FrameDriver::lineIsDirty(unsigned line) const
+{
+    if (!trackDirtyLines || line >= lineHashes.size()) return true;
+    return (dirtyMap[line / 64] >> (line % 64)) & 1;
+}
+
+unsigned
+FrameDriver::dirtyLineCount() const
+{
+    return trackDirtyLines ? dirtyCount : frameHeight();
+}
+
+void
+FrameDriver::updateDirtyLines()
+{
+    unsigned width = frameWidth();
+    unsigned height = frameHeight();
+    const uint32_t *pixels = frameBuffer();
+    
+    // Start over if the texture size has changed
+    if (lineHashes.size() != height) {
+        lineHashes.assign(height, 0);
+        dirtyMap.assign((height + 63) / 64, ~0ULL);
+        dirtyCount = height;
+        bufferHashesValid.assign(externalBuffers.size(), false);
+        for (unsigned y = 0; y < height; y++) {
+            lineHashes[y] = hashLine(pixels + y * width, width);
+        }
+        return;
+    }
+    
+    std::fill(dirtyMap.begin(), dirtyMap.end(), 0);
+    dirtyCount = 0;
+    
+    for (unsigned y = 0; y < height; y++) {
+        
+        uint64_t hash = hashLine(pixels + y * width, width);
+        if (hash != lineHashes[y]) {
+            lineHashes[y] = hash;
+            dirtyMap[y / 64] |= 1ULL << (y % 64);
+            dirtyCount++;
+        }
+    }
+}
+
+unsigned
+FrameDriver::addTrap(uint16_t first, uint16_t last, TrapHandler handler)
+{
+    Trap trap = { nextTrapId++, first, last, false, false, false, handler };
+    traps.push_back(trap);
+    return trap.id;
+}
+
+void
+FrameDriver::removeTrap(unsigned id)
+{
+    traps.erase(std::remove_if(traps.begin(), traps.end(),
+                               [id](const Trap &t) { return t.id == id; }),
+                traps.end());
+}
+
+bool
+FrameDriver::consumeTrap(unsigned id)
+{
+    for (Trap &trap : traps) {
+        if (trap.id == id) {
+            bool latched = trap.latched;
+            trap.latched = false;
+            return latched;
+        }
+    }
+    return false;
+}
+
+unsigned
+FrameDriver::addInputTrap(TrapHandler handler)
+{
+    unsigned id = addTrap(inputLoopFirst, inputLoopLast, handler);
+    traps.back().idleOnly = true;
+    return id;
+}
+
+bool
+FrameDriver::readyPromptVisible() const
+{
+    uint16_t pnt = c64->mem.spypeek(0xD1) | (c64->mem.spypeek(0xD2) << 8);
+    uint16_t lnmx = c64->mem.spypeek(0xD5) + 1;
+    uint16_t addr = pnt - lnmx;
+    const char *s = "READY.";
+    
+    for (unsigned i = 0; s[i] != '\0'; i++) {
+        if (c64->mem.spypeek(addr + i) != s[i] % 64) return false;
+    }
+    return true;
+}
+
+void
+FrameDriver::checkTraps()
+{
+    uint16_t pc = c64->cpu.getPC();
+    
+    for (size_t i = 0; i < traps.size(); i++) {
+        
+        Trap &trap = traps[i];
+        bool inside = pc >= trap.first && pc <= trap.last;
+        
+        // An interrupt served from within the range doesn't leave it
+        if (!inside && trap.inside && c64->cpu.getI()) continue;
+        
+        bool entered = inside && !trap.inside;
+        trap.inside = inside;
+        if (!entered) continue;
+        
+        // The input loop is only known in the stock Kernal
+        if (trap.idleOnly && !stockKernal) continue;
+        
+        // Typed characters are still on their way (check again next frame)
+        if (trap.idleOnly && (typing || c64->mem.spypeek(ndxAddr) != 0)) {
+            trap.inside = false;
+            continue;
+        }
+        
+        trap.latched = true;
+        if (trap.handler) trap.handler(pc);
+    }
+}
+
+void
+FrameDriver::typeText(const std::string &text, unsigned delay,
+                      std::function<void()> completion)
+{
+    // The movie being replayed brings its own text
+    if (replaying && !replayingEvent) return;
+    
+    delay = std::min(delay, 0xFFFFu);
+    recordEvent(INPUT_TEXT, delay & 0xFF, delay >> 8, text);
+    queueText(text, delay, completion);
+}
+
+void
+FrameDriver::queueText(const std::string &text, unsigned delay,
+                       std::function<void()> completion)
+{
+    // Append to the characters not typed yet
+    typeAhead.erase(0, typePos);
+    typePos = 0;
+    
+    for (char c : text) {
+        if (uint8_t p = petscii(c)) typeAhead.push_back((char)p);
+    }
+    
+    if (!typing) typeDelay = delay;
+    if (completion) typeCompletion = completion;
+    typing = true;
+}
+
+void
+FrameDriver::cancelTyping()
+{
+    typeAhead.clear();
+    typePos = 0;
+    typeDelay = 0;
+    typeCompletion = nullptr;
+    typing = false;
+}
+
+void
+FrameDriver::feedKeyboardBuffer()
+{
+    if (typeDelay) { typeDelay--; return; }
+    
+    // Don't interfere with the Kernal while it's shifting the buffer
+    if (c64->mem.spypeek(ndxAddr) != 0) return;
+    
+    if (typePos == typeAhead.size()) {
+        
+        // All characters have been read
+        std::function<void()> completion = typeCompletion;
+        cancelTyping();
+        if (completion) completion();
+        return;
+    }
+    
+    uint8_t max = std::min(c64->mem.spypeek(xmaxAddr), (uint8_t)10);
+    uint8_t count = 0;
+    
+    while (count < max && typePos < typeAhead.size()) {
+        c64->mem.poke(keydAddr + count++, (uint8_t)typeAhead[typePos++]);
+    }
+    c64->mem.poke(ndxAddr, count);
+}
+
+void
+FrameDriver::setRewindRecording(bool value)
+{
+    recordRewind = value;
+    if (!value) rewindBuffer.clear();
+}
+
+bool
+FrameDriver::rewind(unsigned frames)
+{
+    if (!rewindBuffer.restore(frames, rewindState)) return false;
+    return loadState(rewindState.data(), rewindState.size());
+}
+
+void
+FrameDriver::recordState()
+{
+    rewindState.resize(stateSize());
+    
+    size_t size = saveState(rewindState.data(), rewindState.size());
+    if (size) rewindBuffer.push(rewindState.data(), size);
+}
+
+float *
+FrameDriver::audioTarget(size_t count)
+{
+    float *span = audioRing.writeSpan(count);
+    return span ? span : audioBuffer.data();
+}
+
+void
+FrameDriver::publishAudio(float *target)
+{
+    if (target != audioBuffer.data()) {
+        audioRing.commitWrite(audioCount);
+        return;
+    }
+    
+    // The free space wraps or is exhausted
+    droppedSamples += audioCount - audioRing.write(target, audioCount);
+}
+
+void
+FrameDriver::setSampleRate(uint32_t rate)
+{
+    hostRate = rate;
+    applyAudioConfig();
+}
+
+void
+FrameDriver::setAudioOversampling(unsigned factor)
+{
+    oversampling = std::max(1u, std::min(factor, maxOversampling));
+    applyAudioConfig();
+    setRunAhead(runAheadRequest);
+}
+
+void
+FrameDriver::applyAudioConfig()
+{
+    c64->sid.setSampleRate(hostRate * oversampling);
+    if (oversampling > 1) c64->sid.setSamplingMethod(SID_SAMPLE_FAST);
+    
+    oversampleBuffer.resize(audioBuffer.size() * oversampling);
+    decimator.configure(oversampling);
+    pacer.reset(c64->sid);
+}
+
+void
+FrameDriver::setAudioSink(AudioWorker::Sink sink)
+{
+    audioWorker.reset();
+    if (sink) audioWorker.reset(new AudioWorker(sink));
+}
+
+void
+FrameDriver::setRunAhead(unsigned frames)
+{
+    runAheadRequest = frames;
+    runAheadFrames = std::min(frames, std::max(1u, maxRunAheadFrames / oversampling));
+    if (!frames) presentRunAhead = false;
+}
+
+void
+FrameDriver::runAhead()
+{
+    // Save the state without the header and the side effects of saveState()
+    runAheadState.resize(c64->stateSize());
+    uint8_t *ptr = runAheadState.data();
+    c64->saveToBuffer(&ptr);
+    
+    // Remember where SID writes, so the samples computed ahead get overwritten
+    uint32_t writePtr = c64->sid.writePtr;
+    
+    // Typing, traps and the frame counter are left alone in the future
+    for (unsigned i = 0; i < runAheadFrames; i++) c64->executeOneFrame();
+    
+    const uint32_t *texture = (const uint32_t *)c64->vic.screenBuffer();
+    runAheadTexture.assign(texture, texture + frameWidth() * frameHeight());
+    presentRunAhead = true;
+    
+    ptr = runAheadState.data();
+    c64->loadFromBuffer(&ptr);
+    c64->sid.writePtr = writePtr;
+}
+
+void
+FrameDriver::joystickEvent(unsigned port, JoystickEvent event)
+{
+    queueInput(INPUT_JOYSTICK, (uint8_t)port, (uint8_t)event);
+}
+
+void
+FrameDriver::pressKey(unsigned row, unsigned col)
+{
+    queueInput(INPUT_KEY_DOWN, (uint8_t)row, (uint8_t)col);
+}
+
+void
+FrameDriver::releaseKey(unsigned row, unsigned col)
+{
+    queueInput(INPUT_KEY_UP, (uint8_t)row, (uint8_t)col);
+}
+
+void
+FrameDriver::releaseAllKeys()
+{
+    queueInput(INPUT_KEYS_RELEASED);
+}
+
+void
+FrameDriver::pressRestoreKey()
+{
+    queueInput(INPUT_RESTORE_DOWN);
+}
+
+void
+FrameDriver::releaseRestoreKey()
+{
+    queueInput(INPUT_RESTORE_UP);
+}
+
+void
+FrameDriver::reset()
+{
+    if (replaying && !replayingEvent) return;
+    
+    c64->cpu.reset();
+    recordEvent(INPUT_RESET, 0, 0);
+}
+
+void
+FrameDriver::pressPlay()
+{
+    if (replaying && !replayingEvent) return;
+    
+    c64->datasette.pressPlay();
+    recordEvent(INPUT_PLAY, 0, 0);
+}
+
+void
+FrameDriver::queueInput(InputEventType type, uint8_t arg1, uint8_t arg2)
+{
+    std::lock_guard<std::mutex> guard(inputLock);
+    pendingInput.push_back({ type, arg1, arg2 });
+}
+
+void
+FrameDriver::applyInput()
+{
+    inputScratch.clear();
+    {
+        std::lock_guard<std::mutex> guard(inputLock);
+        std::swap(pendingInput, inputScratch);
+    }
+    
+    if (replaying) {
+        
+        const std::vector<InputMovie::Event> &events = replaying->events;
+        uint64_t movieTime = frame - movieFrame;
+        
+        replayingEvent = true;
+        for (; replayPos < events.size() && events[replayPos].frame <= movieTime; replayPos++) {
+            
+            const InputMovie::Event &e = events[replayPos];
+            if (e.frame != movieTime || e.cycle != c64->cpu.cycle - movieCycle) desyncs++;
+            applyEvent(e.type, e.arg1, e.arg2, e.text);
+        }
+        replayingEvent = false;
+        return;
+    }
+    
+    for (const InputEvent &e : inputScratch) {
+        
+        applyEvent(e.type, e.arg1, e.arg2, "");
+        recordEvent(e.type, e.arg1, e.arg2);
+    }
+}
+
+void
+FrameDriver::applyEvent(InputEventType type, uint8_t arg1, uint8_t arg2, const std::string &text)
+{
+    switch (type) {
+            
+        case INPUT_JOYSTICK:
+            (arg1 == 1 ? c64->port1 : c64->port2).trigger((JoystickEvent)arg2);
+            break;
+        case INPUT_KEY_DOWN: c64->keyboard.pressKey(arg1, arg2); break;
+        case INPUT_KEY_UP: c64->keyboard.releaseKey(arg1, arg2); break;
+        case INPUT_KEYS_RELEASED: c64->keyboard.releaseAll(); break;
+        case INPUT_RESTORE_DOWN: c64->keyboard.pressRestoreKey(); break;
+        case INPUT_RESTORE_UP: c64->keyboard.releaseRestoreKey(); break;
+        case INPUT_TEXT: typeText(text, arg1 | (arg2 << 8)); break;
+        case INPUT_PLAY: pressPlay(); break;
+        case INPUT_CARTRIDGE: attachCartridge(text.c_str()); break;
+        case INPUT_TAPE: insertTape(text.c_str()); break;
+        case INPUT_DISK: insertDisk(text.c_str()); break;
+        case INPUT_AUTOSTART: autostart(text.c_str()); break;
+        case INPUT_STATE: loadState((const uint8_t *)text.data(), text.size()); break;
+        case INPUT_RESET: c64->cpu.reset(); break;
+    }
+}
+
+void
+FrameDriver::recordEvent(InputEventType type, uint8_t arg1, uint8_t arg2, const std::string &text)
+{
+    if (!recording) return;
+    
+    InputMovie::Event e;
+    e.frame = frame - movieFrame;
+    e.cycle = c64->cpu.cycle - movieCycle;
+    e.type = type;
+    e.arg1 = arg1;
+    e.arg2 = arg2;
+    e.text = text;
+    recording->events.push_back(e);
+}
+
+void
+FrameDriver::startRecording(InputMovie &movie)
+{
+    replaying = nullptr;
+    c64->keyboard.releaseAll();
+    
+    // The drive power management is not part of the state
+    resetDrivePower();
+    movie.drivePowerSaving = drivePowerSaving;
+    
+    movie.startState.resize(stateSize());
+    movie.startState.resize(saveState(movie.startState.data(), movie.startState.size()));
+    movie.events.clear();
+    movie.frames = 0;
+    movie.finalHash = 0;
+    
+    recording = &movie;
+    movieFrame = frame;
+    movieCycle = c64->cpu.cycle;
+    
+    // Record the text that is still waiting to be typed
+    if (typing && typePos < typeAhead.size()) {
+        
+        unsigned delay = (unsigned)std::min(typeDelay, (uint64_t)0xFFFF);
+        recordEvent(INPUT_TEXT, delay & 0xFF, delay >> 8, typeAhead.substr(typePos));
+    }
+}
+
+void
+FrameDriver::stopRecording()
+{
+    if (!recording) return;
+    
+    recording->frames = frame - movieFrame;
+    recording->finalHash = stateHash();
+    recording = nullptr;
+}
+
+bool
+FrameDriver::startReplay(const InputMovie &movie)
+{
+    recording = nullptr;
+    
+    // Manage the drives like the recording did (loadState() resets the rest)
+    setDrivePowerSaving(movie.drivePowerSaving);
+    if (!loadState(movie.startState.data(), movie.startState.size())) return false;
+    
+    cancelTyping();
+    {
+        std::lock_guard<std::mutex> guard(inputLock);
+        pendingInput.clear();
+    }
+    
+    replaying = &movie;
+    replayPos = 0;
+    movieFrame = frame;
+    movieCycle = c64->cpu.cycle;
+    desyncs = 0;
+    replayMatched = false;
+    
+    // An empty movie is verified right away
+    if (movie.frames == 0) {
+        replayMatched = stateHash() == movie.finalHash;
+        replaying = nullptr;
+    }
+    return true;
+}
+
+uint64_t
+FrameDriver::stateHash()
+{
+    stateBuffer.resize(stateSize());
+    
+    size_t size = saveState(stateBuffer.data(), stateBuffer.size());
+    return InputMovie::hashState(stateBuffer.data(), size);
+}
+
+void
+FrameDriver::dumpProfile() const
+{
+    double n = profile.frames ? (double)profile.frames : 1.0;
+    
+    printf("Profile of %llu frames (averages per frame)\n", (unsigned long long)profile.frames);
+    printf("        C64 CPU: %10.1f cycles\n", profile.cpuCycles / n);
+    printf("    Drive 1 CPU: %10.1f cycles\n", profile.drive1Cycles / n);
+    printf("    Drive 2 CPU: %10.1f cycles\n", profile.drive2Cycles / n);
+    printf("          Audio: %10.1f samples\n", profile.audioSamples / n);
+    printf("      Emulation: %10.1f us\n", profile.emulationNanos / n / 1000.0);
+    printf("          Input: %10.1f us\n", profile.inputNanos / n / 1000.0);
+    printf("          Audio: %10.1f us\n", profile.audioNanos / n / 1000.0);
+    printf("          Video: %10.1f us\n", profile.videoNanos / n / 1000.0);
+    printf("         Rewind: %10.1f us\n", profile.rewindNanos / n / 1000.0);
+    printf("      Run-ahead: %10.1f us\n", profile.runAheadNanos / n / 1000.0);
+}
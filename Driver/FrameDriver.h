@@ -0,0 +1,854 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _FRAMEDRIVER_INC
+#define _FRAMEDRIVER_INC
+
+#include "C64.h"
+#include "FrameDriver_types.h"
+#include "AudioPacer.h"
+#include "RewindBuffer.h"
+#include "InputMovie.h"
+#include "FastDrive.h"
+#include "FirDecimator.h"
+#include "AudioWorker.h"
+#include "SampleRing.h"
+#include "IndexedFrame.h"
+#include "DiskCache.h"
+#include "MediaFile.h"
+#include <string>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/* Portable frame loop around a C64 instance.
+ * The driver owns the emulator and performs the same steps the OpenEmu core
+ * performs on every frame: run the C64 for one frame, then fetch the samples
+ * SID has produced in the meantime. It has no dependencies on Cocoa or
+ * OpenEmu and can be used by headless tools.
+ */
+class FrameDriver {
+    
+public:
+    
+    // The emulator driven by this object
+    C64 *c64;
+    
+    // Handler invoked when the CPU reaches a trapped address range
+    typedef std::function<void(uint16_t pc)> TrapHandler;
+    
+private:
+    
+    struct Trap {
+        unsigned id;
+        uint16_t first;
+        uint16_t last;
+        bool idleOnly;  // Only fires while no typed text is pending
+        bool inside;    // The CPU was inside the range at the last check
+        bool latched;   // Fired and not yet consumed
+        TrapHandler handler;
+    };
+    
+    // Registered program address traps
+    std::vector<Trap> traps;
+    unsigned nextTrapId = 1;
+    
+    // Indicates that the stock Kernal (901227-03) has been flashed by loadRoms()
+    bool stockKernal = false;
+    
+    struct InputEvent {
+        InputEventType type;
+        uint8_t arg1;
+        uint8_t arg2;
+    };
+    
+    // Input events waiting for the next frame
+    std::mutex inputLock;
+    std::vector<InputEvent> pendingInput;
+    std::vector<InputEvent> inputScratch;
+    
+    // Movie being recorded or replayed
+    InputMovie *recording = nullptr;
+    const InputMovie *replaying = nullptr;
+    size_t replayPos = 0;
+    
+    // Frame and CPU cycle the movie started at
+    uint64_t movieFrame = 0;
+    uint64_t movieCycle = 0;
+    
+    // Replay results
+    long desyncs = 0;
+    bool replayMatched = false;
+    
+    // Indicates that the driver is applying an event read from a movie
+    bool replayingEvent = false;
+    
+    // Indicates if typed characters have not been consumed yet
+    bool typing = false;
+    
+    // PETSCII characters waiting to be put into the keyboard buffer
+    std::string typeAhead;
+    size_t typePos = 0;
+    
+    // Number of frames to wait before the first character is typed
+    uint64_t typeDelay = 0;
+    
+    // Invoked once the Kernal has consumed all typed characters
+    std::function<void()> typeCompletion;
+    
+    // Scratch buffer for saving and loading states through files
+    std::vector<uint8_t> stateBuffer;
+    
+    // Statistics of the latest state transfer
+    StateInfo saveInfo = { };
+    StateInfo loadInfo = { };
+    
+    // States of the most recent frames
+    RewindBuffer rewindBuffer;
+    bool recordRewind = false;
+    
+    // Scratch buffer for recording and restoring rewind states
+    std::vector<uint8_t> rewindState;
+    
+    // Number of frames emulated ahead of the presented frame (and as requested)
+    unsigned runAheadFrames = 0;
+    unsigned runAheadRequest = 0;
+    
+    // State of the machine while running ahead
+    std::vector<uint8_t> runAheadState;
+    
+    // The frame computed ahead and an indicator if it's presented
+    std::vector<uint32_t> runAheadTexture;
+    bool presentRunAhead = false;
+    
+    // Indicates if drives are switched off while they are not needed
+    bool drivePowerSaving = false;
+    
+    // Number of frames drive 1 has been idle without a disk
+    unsigned driveIdleFrames = 0;
+    
+    // State of drive 1 when it was switched off
+    std::vector<uint8_t> driveIdleState;
+    
+    // Emulation mode of drive 1
+    DriveMode driveMode = DRIVE_CYCLE_EXACT;
+    
+    // Serves the disk in high-level mode
+    FastDrive fastDrive;
+    
+    // Indicates if disks are inserted into the 1541 when it is first used
+    bool lazyDiskInsert = false;
+    
+    // Disk waiting to be inserted into the 1541 (owned by the driver)
+    AnyArchive *pendingDisk = nullptr;
+    
+    // Encoded disks of earlier launches
+    DiskCache diskCache;
+    
+    // Cache key of the disk that is yet to be inserted into the 1541
+    std::string diskKey;
+    
+    // Profiling counters of the latest call to executeFrame() and in total
+    bool profiling = false;
+    ProfileInfo frameProfile = { };
+    ProfileInfo profile = { };
+    
+    // Samples handed to the host, waiting to be consumed
+    SampleRing audioRing;
+    
+    // Number of samples produced during the latest frame
+    size_t audioCount = 0;
+    
+    // Number of samples lost because the host didn't drain audioRing
+    uint64_t droppedSamples = 0;
+    
+    // Holds the samples of a frame if the free space of audioRing wraps
+    std::vector<float> audioBuffer;
+    
+    // Transfers the samples of each frame without drifting
+    AudioPacer pacer;
+    
+    // Sample rate of the host and the ratio of SID's sample rate and that rate
+    uint32_t hostRate = 44100;
+    unsigned oversampling = 1;
+    
+    // Filters the oversampled SID output down to the host rate
+    FirDecimator decimator;
+    std::vector<float> oversampleBuffer;
+    
+    // Post-processes audio on a separate thread if a sink is set
+    std::unique_ptr<AudioWorker> audioWorker;
+    
+    // Number of emulated frames since power up
+    uint64_t frame = 0;
+    
+    // Warp settings (see setWarp() and setWarpLoad())
+    bool alwaysWarp = false;
+    bool warpLoad = true;
+    unsigned warpFactor = 8;
+    
+    // Indicates if the latest call to executeFrame() was warping
+    bool warping = false;
+    
+    // Samples of all frames emulated during a warped executeFrame()
+    std::vector<float> warpBuffer;
+    
+    // Samples left over when decimating warped frames
+    size_t warpRemainder = 0;
+    
+    /* Host supplied frame buffers.
+     * If set, swapFrameBuffers() moves the latest VIC frame into the next
+     * buffer of this ring. Two or three buffers allow the host to scan out
+     * one buffer while the next frame is being prepared.
+     */
+    std::vector<uint32_t *> externalBuffers;
+    unsigned backBuffer = 0;
+    
+    // The host buffer holding the most recently presented frame
+    uint32_t *frontBuffer = nullptr;
+    
+    // Indicates if the driver keeps track of modified raster lines
+    bool trackDirtyLines = false;
+    
+    // Hash value of each line of the latest frame
+    std::vector<uint64_t> lineHashes;
+    
+    // One bit per line, set if the line differs from the previous frame
+    std::vector<uint64_t> dirtyMap;
+    unsigned dirtyCount = 0;
+    
+    /* Line hashes of the frame stored in each host buffer.
+     * They allow swapFrameBuffers() to copy changed lines only. Buffers
+     * without valid hashes receive a full copy.
+     */
+    std::vector<std::vector<uint64_t>> bufferHashes;
+    std::vector<bool> bufferHashesValid;
+    
+    // Indicates if the latest frame is kept as color indices
+    bool indexedOutput = false;
+    
+    // The latest frame as color indices (see setIndexedOutput())
+    IndexedFrame indexedFrame;
+    
+public:
+    
+    FrameDriver();
+    ~FrameDriver();
+    
+    
+    //
+    // Configuring
+    //
+    
+    // Applies the default configuration used by the OpenEmu core
+    void configure(VICModel model = NTSC_6567);
+    
+    /* Loads Basic, Kernal, Character and VC1541 ROM from a directory.
+     * The JiffyDOS images are preferred if present and 'jiffyDOS' is true.
+     * On failure, the path of the missing or invalid ROM is stored in
+     * 'failedRom' and false is returned.
+     */
+    bool loadRoms(const std::string &dir, bool jiffyDOS, std::string *failedRom = nullptr);
+    
+    /* Checks if the flashed Kernal is the stock ROM.
+     * The Kernal's fingerprint is compared with the one of the stock image
+     * found by loadRoms(). Code that relies on addresses inside the Kernal
+     * (the input trap, the hooks of the high-level drive) requires it.
+     */
+    bool hasStockKernal() const { return stockKernal; }
+    
+    
+    //
+    // Attaching media
+    //
+    
+    /* The following functions take a path or an opened MediaFile.
+     * Hosts that look at a file before attaching it should open it once as
+     * a MediaFile and pass it on, so the file is only read once.
+     */
+    
+    // Determines the kind of media stored in a file
+    static MediaType mediaTypeOfFile(const char *path);
+    
+    // Attaches a cartridge and resets the machine
+    bool attachCartridge(const MediaFile &file);
+    bool attachCartridge(const char *path) { return attachCartridge(MediaFile(path)); }
+    
+    // Inserts a tape into the datasette
+    bool insertTape(const MediaFile &file);
+    bool insertTape(const char *path) { return insertTape(MediaFile(path)); }
+    
+    // Inserts a disk or archive into drive 1
+    bool insertDisk(const MediaFile &file);
+    bool insertDisk(const char *path) { return insertDisk(MediaFile(path)); }
+    
+    // Attaches a file of any supported media type
+    bool attachMedia(const MediaFile &file);
+    bool attachMedia(const char *path) { return attachMedia(MediaFile(path)); }
+    
+    /* Starts a program without emulating the load process.
+     * If the archive contains a single program located at the start of BASIC
+     * memory, the program is written into RAM, the BASIC pointers are set up
+     * as LOAD would do, and RUN is typed. Disk images are inserted into drive
+     * 1 as well, because the program may read further files. Returns false if
+     * the file needs to be loaded by the drive, e.g., if it contains multiple
+     * programs. The machine must be at the READY prompt.
+     */
+    bool autostart(const MediaFile &file);
+    bool autostart(const char *path) { return autostart(MediaFile(path)); }
+    
+    
+    //
+    // Running
+    //
+    
+    // Powers on all sub components (mirrors OEGameCore's setupEmulation)
+    void powerUp();
+    
+    // Resets the CPU (recorded into a movie being recorded)
+    void reset();
+    
+    /* Emulates a single frame and fetches the produced audio samples.
+     * In warp mode, multiple frames are emulated and their samples are
+     * decimated to the number of samples of a single frame.
+     */
+    void executeFrame();
+    
+    // Returns the number of frames executed since power up
+    uint64_t frameCount() const { return frame; }
+    
+    
+    //
+    // Warping
+    //
+    
+    // Warps unconditionally (fast forward)
+    bool getWarp() const { return alwaysWarp; }
+    void setWarp(bool value) { alwaysWarp = value; }
+    
+    // Warps while the drive is spinning or the datasette motor is running
+    bool getWarpLoad() const { return warpLoad; }
+    void setWarpLoad(bool value) { warpLoad = value; }
+    
+    // Number of frames emulated by a single call to executeFrame() in warp mode
+    unsigned getWarpFactor() const { return warpFactor; }
+    void setWarpFactor(unsigned value) { warpFactor = std::max(value, 1u); }
+    
+    // Checks if the latest call to executeFrame() was warping
+    bool isWarping() const { return warping; }
+    
+    
+    //
+    // Saving power
+    //
+    
+    /* Switches off drives that are not needed.
+     * Drive 2 is never used and is switched off right away. Drive 1 is
+     * switched off once it has been idle without a disk for two seconds. Its
+     * state is saved at that moment and restored when a disk is inserted,
+     * so the drive answers the bus immediately instead of running its reset
+     * routine again. A drive holding a disk keeps running, because the
+     * driver only sees frame boundaries and can't wake the drive in time
+     * when the Kernal addresses the bus.
+     */
+    bool getDrivePowerSaving() const { return drivePowerSaving; }
+    void setDrivePowerSaving(bool value);
+    
+    
+    //
+    // Emulating the drive
+    //
+    
+    /* Selects how drive 1 is emulated.
+     * In high-level mode, disks are not inserted into the 1541. LOAD and
+     * the directory are served by the Kernal hooks of FastDrive. Images
+     * without files (G64) are inserted into the 1541 as usual. Once the
+     * machine opens a channel to drive 8 or saves to it, e.g., to upload a
+     * fast loader with M-W and M-E, the disk is handed over to the 1541 and
+     * the Kernal call continues there. Programs that talk to the bus with
+     * LISTEN, SECOND and CIOUT directly reach the empty 1541 instead. The
+     * disk is handed over as soon as they spin the drive up. With drive
+     * power saving, the empty 1541 is switched off and these programs find
+     * no drive at all. Changing the mode hands over a disk as well. The
+     * hooks need the stock Kernal. With any other Kernal (e.g. JiffyDOS),
+     * or once a program overwrites the hooks, disks go to the 1541.
+     */
+    DriveMode getDriveMode() const { return driveMode; }
+    void setDriveMode(DriveMode mode);
+    
+    // Checks if the disk is currently served by the high-level drive
+    bool isServingDisk() const { return fastDrive.hasDisk(); }
+    
+    /* Inserts disks into the 1541 when they are first accessed.
+     * Inserting a D64 image GCR-encodes all of its tracks. If enabled, the
+     * disk is held back until the Kernal calls LOAD, OPEN or SAVE for drive 8
+     * (caught by the hooks of FastDrive) or the drive spins up because a
+     * program talks to it directly. A title that is started from memory or
+     * never touches the disk doesn't pay for the encoding at all. Like in
+     * high-level mode, a saved state doesn't contain a disk that is held
+     * back.
+     */
+    bool getLazyDiskInsert() const { return lazyDiskInsert; }
+    void setLazyDiskInsert(bool value);
+    bool hasPendingDisk() const { return pendingDisk != nullptr; }
+    
+    /* Keeps encoded disks in a directory.
+     * If a directory is set, disks inserted into the 1541 are taken from
+     * the cache if the same image has been encoded before, and are added to
+     * the cache otherwise. An empty string disables the cache.
+     */
+    void setDiskCacheDirectory(const std::string &dir) { diskCache.setDirectory(dir); }
+    const DiskCache &getDiskCache() const { return diskCache; }
+    
+    
+    //
+    // Sending input
+    //
+    
+    /* Sends input to the emulator.
+     * The events are queued and applied at the beginning of the next frame.
+     * Hence, these functions can be called from any thread.
+     */
+    void joystickEvent(unsigned port, JoystickEvent event);
+    void pressKey(unsigned row, unsigned col);
+    void releaseKey(unsigned row, unsigned col);
+    void releaseAllKeys();
+    void pressRestoreKey();
+    void releaseRestoreKey();
+    
+    // Presses the play key of the datasette (emulator thread only)
+    void pressPlay();
+    
+    
+    //
+    // Recording and replaying input
+    //
+    
+    /* Starts recording all input into 'movie'.
+     * The current state becomes the start state of the movie. Keys held
+     * down are released first. Input, typed text and attached media are
+     * recorded until stopRecording() is called. Text waiting to be typed is
+     * recorded as well, but its completion handler is not.
+     */
+    void startRecording(InputMovie &movie);
+    
+    // Stops recording and stores the number of frames and the final state hash
+    void stopRecording();
+    bool isRecording() const { return recording != nullptr; }
+    
+    /* Restores the start state of a movie and replays its events.
+     * Each event is applied at the beginning of the frame it was recorded
+     * in. Events whose CPU cycle differs from the recording are counted as
+     * desyncs. Live input is ignored while replaying. Once all frames of the
+     * movie have been emulated, the replay stops and the state hash is
+     * compared with the recording. The movie must stay alive until then.
+     */
+    bool startReplay(const InputMovie &movie);
+    void stopReplay() { replaying = nullptr; }
+    bool isReplaying() const { return replaying != nullptr; }
+    
+    // Informs about the result of the latest replay
+    long replayDesyncs() const { return desyncs; }
+    bool replayVerified() const { return replayMatched; }
+    
+    // Computes the hash of the current state (see InputMovie::hashState())
+    uint64_t stateHash();
+    
+    
+    //
+    // Trapping
+    //
+    
+    /* Registers a trap for a range of program addresses.
+     * This is not an instruction hook: the program counter is only sampled
+     * at the end of each frame, so code that runs through the range in
+     * less than a frame may go unnoticed. It suits loops the CPU spins in.
+     * The trap fires when the sampled PC enters [first; last] and doesn't
+     * fire again before the PC has been seen outside the range. A PC found
+     * outside while an interrupt is being served doesn't count, so an IRQ
+     * interrupting the loop doesn't make the trap fire twice. Firing calls
+     * the handler (if any) and latches the trap until consumeTrap() is
+     * called. Returns an id for removeTrap() and consumeTrap().
+     */
+    unsigned addTrap(uint16_t first, uint16_t last, TrapHandler handler = nullptr);
+    void removeTrap(unsigned id);
+    
+    // Checks if a trap has fired since the last call and clears the latch
+    bool consumeTrap(unsigned id);
+    
+    /* Registers a trap for the Kernal loop waiting for keyboard input.
+     * The trap fires when BASIC waits at the READY prompt with an empty
+     * keyboard buffer. It is ignored while text is being typed and never
+     * fires without the stock Kernal, because other Kernals (e.g. JiffyDOS)
+     * wait elsewhere. Use readyPromptVisible() for them.
+     */
+    unsigned addInputTrap(TrapHandler handler = nullptr);
+    
+    /* Checks if the line above the cursor reads "READY.".
+     * This is the slow path for Kernals that wait for input elsewhere.
+     */
+    bool readyPromptVisible() const;
+    
+    
+    //
+    // Typing
+    //
+    
+    /* Types a string by feeding the Kernal keyboard buffer.
+     * Characters are written to $0277 and counted in $C6 at the beginning of
+     * a frame, but only if the Kernal has emptied the buffer. Hence, typing
+     * depends on emulated time only. It is deterministic, keeps pace in warp
+     * mode and blocks no thread. Letters are typed unshifted. Typing starts
+     * after 'delay' frames. 'completion' is invoked on the emulator thread
+     * once the last character has been read by the Kernal.
+     */
+    void typeText(const std::string &text, unsigned delay = 0,
+                  std::function<void()> completion = nullptr);
+    
+    // Checks if characters are still waiting to be read by the Kernal
+    bool isTyping() const { return typing; }
+    
+    // Discards all pending characters
+    void cancelTyping();
+    
+    
+    //
+    // Saving and restoring state
+    //
+    
+    /* Returns the number of bytes needed by saveState().
+     * The value is an upper bound which becomes invalid as soon as the
+     * machine is modified, e.g., by running a frame or attaching a cartridge.
+     */
+    size_t stateSize() const;
+    
+    /* Serializes the machine into a caller provided buffer.
+     * Each component writes its state directly into the buffer behind a small
+     * header. No intermediate snapshot object is created. Returns the number
+     * of bytes written or 0 if the buffer is too small.
+     */
+    size_t saveState(uint8_t *buffer, size_t capacity);
+    
+    /* Restores a state written by saveState().
+     * Returns false if the buffer does not contain a state of this version.
+     * An input movie being recorded keeps going and gets the state as an
+     * event, so loading a state or rewinding doesn't cut the movie short.
+     * The drive power management starts over, because its state isn't part
+     * of the saved state.
+     */
+    bool loadState(const uint8_t *buffer, size_t size);
+    
+    // Writes the state to a file descriptor or a file
+    bool saveState(int fd);
+    bool saveStateToFile(const char *path);
+    
+    /* Reads a state from a file descriptor or a file.
+     * Snapshot files written by older versions of the core are accepted, too.
+     */
+    bool loadState(int fd);
+    bool loadStateFromFile(const char *path);
+    
+    // Informs about the latest save and load operation
+    StateInfo getSaveInfo() const { return saveInfo; }
+    StateInfo getLoadInfo() const { return loadInfo; }
+    
+    
+    //
+    // Rewinding
+    //
+    
+    // Records the state after every call to executeFrame()
+    bool getRewindRecording() const { return recordRewind; }
+    void setRewindRecording(bool value);
+    
+    // Gives access to the budget and keyframe interval of the rewind buffer
+    RewindBuffer &getRewindBuffer() { return rewindBuffer; }
+    
+    /* Restores the state recorded 'frames' frames ago.
+     * All newer states are discarded. The state recorded by the latest call
+     * to executeFrame() is 0 frames ago.
+     */
+    bool rewind(unsigned frames);
+    
+    
+    //
+    // Running ahead
+    //
+    
+    /* Hides the input lag of games by running ahead.
+     * If 'frames' is greater than zero, executeFrame() emulates the next frame
+     * as usual. It then saves the state, emulates the given number of frames
+     * with the current input, keeps the picture of the last one, and restores
+     * the saved state. The audio of the frames run ahead is discarded. Running
+     * ahead is paused while warping and limited to four frames divided by
+     * the audio oversampling factor.
+     */
+    unsigned getRunAhead() const { return runAheadFrames; }
+    void setRunAhead(unsigned frames);
+    
+    
+    //
+    // Profiling
+    //
+    
+    /* Enables the profiling counters.
+     * If enabled, executeFrame() counts the cycles executed by the C64 and
+     * the drives and measures the host time spent in each part of the frame.
+     * If disabled, no clocks are read and the counters stay untouched.
+     */
+    bool getProfiling() const { return profiling; }
+    void setProfiling(bool value) { profiling = value; }
+    
+    // Returns the counters of the latest call to executeFrame()
+    ProfileInfo getFrameProfileInfo() const { return frameProfile; }
+    
+    // Returns the counters accumulated since the last reset
+    ProfileInfo getProfileInfo() const { return profile; }
+    void resetProfile() { profile = { }; frameProfile = { }; }
+    
+    // Prints the accumulated counters as averages per frame
+    void dumpProfile() const;
+    
+    
+    //
+    // Caching the boot process
+    //
+    
+    /* Returns a key identifying the state of a freshly booted machine.
+     * The key is derived from the ROM fingerprints and the VIC and SID
+     * models, i.e., everything that influences the state of the machine
+     * when it reaches the READY prompt.
+     */
+    uint64_t bootKey() const;
+    
+    // Returns the path of the boot snapshot for the current configuration
+    std::string bootSnapshotPath(const std::string &dir) const;
+    
+    /* Stores a snapshot of the machine in the cache directory.
+     * Call this function once the machine has reached the READY prompt.
+     */
+    bool saveBootSnapshot(const std::string &dir);
+    
+    /* Restores the machine from the cache directory.
+     * Returns false if no snapshot exists for the current configuration.
+     */
+    bool restoreBootSnapshot(const std::string &dir);
+    
+    
+    //
+    // Accessing output
+    //
+    
+    // Returns the size of the emulator texture in pixels
+    unsigned frameWidth() const { return NTSC_PIXELS; }
+    unsigned frameHeight() const { return c64->vic.isPAL() ? PAL_RASTERLINES : NTSC_RASTERLINES; }
+    
+    /* Returns the texture of the latest completed frame.
+     * This is VIC's stable buffer which is accessed without copying. It stays
+     * valid until the next call to executeFrame(), because VIC draws the next
+     * frame into its second buffer. When running ahead, the texture of the
+     * frame computed ahead is returned instead.
+     */
+    const uint32_t *frameBuffer() const {
+        return presentRunAhead ? runAheadTexture.data() : (const uint32_t *)c64->vic.screenBuffer();
+    }
+    
+    // Registers 'count' host buffers of frameWidth() * frameHeight() pixels
+    void setExternalFrameBuffers(uint32_t *const *buffers, unsigned count);
+    
+    /* Presents the latest frame in the next host buffer.
+     * Returns the buffer which becomes the front buffer or NULL if no host
+     * buffers are registered.
+     */
+    uint32_t *swapFrameBuffers();
+    
+    // Returns the host buffer presented by the last swap
+    uint32_t *presentedFrameBuffer() const { return frontBuffer; }
+    
+    /* Keeps the latest frame as 4-bit color indices.
+     * If enabled, executeFrame() packs each frame (only the modified lines if
+     * dirty tracking is enabled), and swapFrameBuffers() expands it into the
+     * host buffer with the current palette. Hosts that keep frames around,
+     * e.g., as previews, store indexedFrameBuffer() at an eighth of the size
+     * and expand it with any palette later.
+     */
+    bool getIndexedOutput() const { return indexedOutput; }
+    void setIndexedOutput(bool value);
+    const IndexedFrame &indexedFrameBuffer() const { return indexedFrame; }
+    
+    // Returns the 16 colors VIC currently draws with
+    void getPalette(uint32_t palette[16]) const;
+    
+    
+    //
+    // Tracking modified lines
+    //
+    
+    bool getDirtyTracking() const { return trackDirtyLines; }
+    void setDirtyTracking(bool value);
+    
+    /* Informs about the lines that changed during the latest frame.
+     * The information is only available if dirty tracking is enabled. If it
+     * is disabled, all lines are reported as dirty.
+     */
+    bool lineIsDirty(unsigned line) const;
+    unsigned dirtyLineCount() const;
+    bool frameChanged() const { return dirtyLineCount() != 0; }
+    
+    // Returns the dirty bitmap (bit n of word n / 64 represents line n)
+    const uint64_t *dirtyBitmap() const { return dirtyMap.data(); }
+    
+    /* Returns the ring holding the samples for the host.
+     * executeFrame() appends the samples of each frame, and the host drains
+     * them with readSpans() and commitRead(), e.g., by copying the spans into
+     * its own audio buffer. Samples are dropped if the ring is full.
+     */
+    SampleRing &audioOutput() { return audioRing; }
+    
+    // Returns the number of samples produced during the latest frame
+    size_t audioSampleCount() const { return audioCount; }
+    
+    // Returns the number of samples dropped because the ring was full
+    uint64_t droppedAudioSamples() const { return droppedSamples; }
+    
+    /* Sets the sample rate of the samples handed to the host.
+     * The driver keeps the rate and derives SID's rate from it. SID's rate
+     * is reapplied after each state load, because a state may come from a
+     * session with a different rate or oversampling factor.
+     */
+    uint32_t sampleRate() const { return hostRate; }
+    void setSampleRate(uint32_t rate);
+    
+    /* Lets SID sample at a multiple of the host rate.
+     * SID runs with the fast sampling method at 'factor' times the host
+     * rate, and the driver filters the output down to the host rate. This
+     * sounds like reSID's resampling method, but costs only a few
+     * nanoseconds per sample. The factor is limited to 4.
+     */
+    unsigned getAudioOversampling() const { return oversampling; }
+    void setAudioOversampling(unsigned factor);
+    
+    // Gives access to the decimation filter (its kernel is used by the audio thread too)
+    FirDecimator &audioDecimator() { return decimator; }
+    
+    /* Moves audio post-processing to a separate thread.
+     * If a sink is set, the samples of each frame are copied out of SID and
+     * queued for an audio thread, which filters oversampled and warped
+     * frames and hands the result to the sink. audioSampleCount() is zero
+     * then. Passing NULL stops the thread and returns to audioOutput().
+     */
+    void setAudioSink(AudioWorker::Sink sink);
+    bool hasAudioSink() const { return audioWorker != nullptr; }
+    long droppedAudioBlocks() const { return audioWorker ? audioWorker->droppedBlocks() : 0; }
+    
+    // Informs about the state of the audio pipeline
+    const AudioPacer &audioPacer() const { return pacer; }
+    long audioUnderruns() const { return pacer.underruns(c64->sid); }
+    long audioOverruns() const { return pacer.overruns(c64->sid); }
+    
+private:
+    
+    // Computes the line hashes of the latest frame and updates the dirty map
+    void updateDirtyLines();
+    
+    // Packs the modified lines of the latest frame into indexedFrame
+    void packFrame();
+    
+    // Emulates a single frame without fetching audio
+    void runFrame();
+    
+    /* Returns the place to write the samples of the latest frame to.
+     * This is the free space of the output ring if it holds 'count'
+     * contiguous samples, and audioBuffer otherwise.
+     */
+    float *audioTarget(size_t count);
+    
+    // Appends the audioCount samples written to 'target' to the output ring
+    void publishAudio(float *target);
+    
+    // Checks if a load is in progress that should be warped through
+    bool isLoading() const;
+    
+    // Adds the current state to the rewind buffer
+    void recordState();
+    
+    // Computes the picture of a future frame and returns to the current state
+    void runAhead();
+    
+    // Switches drives off and on as needed
+    void manageDrivePower();
+    
+    // Wakes drive 1, restarts its idle count, and powers drive 2 as configured
+    void resetDrivePower();
+    
+    // Configures SID, the decimator and the pacer for the host rate and oversampling
+    void applyAudioConfig();
+    
+    // Switches drive 1 on and restores the state it was switched off in
+    void wakeDrive();
+    
+    // Inserts a disk into drive 1 or the high-level drive (takes ownership)
+    void insertArchive(AnyArchive *archive);
+    
+    // Inserts a disk into the 1541 (takes ownership)
+    void insertIntoDrive(AnyArchive *archive);
+    
+    // Sets the cache key of a disk read from a file
+    void setDiskKey(AnyArchive *archive, const MediaFile &file);
+    
+    // Ejects the disk of the 1541 and holds back a new one (takes ownership)
+    void deferInsert(AnyArchive *archive);
+    
+    // Inserts the held back disk once the 1541 is accessed
+    void servePendingDisk();
+    
+    // Moves the disk from the high-level drive into the 1541
+    void handOverDisk();
+    
+    // Answers Kernal calls waiting in the hooks of the high-level drive
+    void serveFastDrive();
+    
+    // Queues an input event for the next frame
+    void queueInput(InputEventType type, uint8_t arg1 = 0, uint8_t arg2 = 0);
+    
+    // Applies queued input and events from the movie being replayed
+    void applyInput();
+    void applyEvent(InputEventType type, uint8_t arg1, uint8_t arg2, const std::string &text);
+    
+    // Adds an event to the movie being recorded
+    void recordEvent(InputEventType type, uint8_t arg1, uint8_t arg2, const std::string &text = "");
+    
+    // Types text without recording it
+    void queueText(const std::string &text, unsigned delay, std::function<void()> completion);
+    
+    // Checks the program counter against all registered traps
+    void checkTraps();
+    
+    // Moves pending characters into the Kernal keyboard buffer
+    void feedKeyboardBuffer();
+};
+
+#endif
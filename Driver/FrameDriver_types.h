@@ -0,0 +1,99 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _FRAMEDRIVER_TYPES_INC
+#define _FRAMEDRIVER_TYPES_INC
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Enumerations
+//
+
+typedef enum : long
+{
+    MEDIA_UNKNOWN = 0,
+    MEDIA_CARTRIDGE,
+    MEDIA_TAPE,
+    MEDIA_ARCHIVE
+}
+MediaType;
+
+typedef enum : uint8_t
+{
+    INPUT_JOYSTICK = 0,   // Joystick event (port, JoystickEvent)
+    INPUT_KEY_DOWN,       // Key pressed (row, column)
+    INPUT_KEY_UP,         // Key released (row, column)
+    INPUT_KEYS_RELEASED,  // All keys released
+    INPUT_RESTORE_DOWN,   // Restore key pressed
+    INPUT_RESTORE_UP,     // Restore key released
+    INPUT_TEXT,           // Text typed into the keyboard buffer (text, delay)
+    INPUT_PLAY,           // Datasette play key pressed
+    INPUT_CARTRIDGE,      // Cartridge attached (path)
+    INPUT_TAPE,           // Tape inserted (path)
+    INPUT_DISK,           // Disk inserted (path)
+    INPUT_AUTOSTART,      // Program started from an archive (path)
+    INPUT_STATE,          // State loaded or rewound to (state)
+    INPUT_RESET           // CPU reset
+}
+InputEventType;
+
+typedef enum : long
+{
+    DRIVE_CYCLE_EXACT = 0,  // 1541 with a bit accurate read/write head
+    DRIVE_FAST,             // 1541 with a faster, read-only head
+    DRIVE_HIGH_LEVEL        // Kernal calls are answered from the disk image
+}
+DriveMode;
+
+
+//
+// Structures
+//
+
+typedef struct
+{
+    size_t bytes;        // Size of the serialized state including the header
+    uint64_t nanoseconds; // Time needed to serialize or deserialize the state
+}
+StateInfo;
+
+typedef struct
+{
+    uint64_t frames;          // Number of emulated frames
+    uint64_t cpuCycles;       // Cycles executed by the CPU of the C64
+    uint64_t drive1Cycles;    // Cycles executed by the CPU of drive 1
+    uint64_t drive2Cycles;    // Cycles executed by the CPU of drive 2
+    uint64_t audioSamples;    // Samples handed to the host
+    uint64_t emulationNanos;  // Emulating the machine (CPU, VIC, SID, CIAs, drives)
+    uint64_t inputNanos;      // Applying input, typing and checking traps
+    uint64_t audioNanos;      // Pacing and resampling audio
+    uint64_t videoNanos;      // Tracking modified lines and presenting frames
+    uint64_t rewindNanos;     // Recording rewind states
+    uint64_t runAheadNanos;   // Running ahead
+}
+ProfileInfo;
+
+#endif
@@ -0,0 +1,296 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "IndexedFrame.h"
+#include <climits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define INDEXED_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define INDEXED_NEON
+#include <arm_neon.h>
+#endif
+
+static void
+expandScalar(const uint8_t *in, uint32_t *out, size_t count, const uint32_t *palette)
+{
+    for (size_t i = 0; i + 1 < count; i += 2, in++) {
+        out[i] = palette[*in & 0x0F];
+        out[i + 1] = palette[*in >> 4];
+    }
+    if (count & 1) out[count - 1] = palette[*in & 0x0F];
+}
+
+#ifdef INDEXED_X86
+
+__attribute__((target("ssse3"))) static void
+expandSSSE3(const uint8_t *in, uint32_t *out, size_t count, const uint32_t *palette)
+{
+    // Byte n of all colors, indexed by the color number
+    uint8_t bytes[4][16];
+    for (unsigned i = 0; i < 16; i++) {
+        for (unsigned n = 0; n < 4; n++) bytes[n][i] = (uint8_t)(palette[i] >> (8 * n));
+    }
+    __m128i plane0 = _mm_loadu_si128((const __m128i *)bytes[0]);
+    __m128i plane1 = _mm_loadu_si128((const __m128i *)bytes[1]);
+    __m128i plane2 = _mm_loadu_si128((const __m128i *)bytes[2]);
+    __m128i plane3 = _mm_loadu_si128((const __m128i *)bytes[3]);
+    __m128i mask = _mm_set1_epi8(0x0F);
+    
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32, in += 16) {
+        
+        // Split the nibbles into 32 indices in pixel order
+        __m128i packed = _mm_loadu_si128((const __m128i *)in);
+        __m128i lo = _mm_and_si128(packed, mask);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(packed, 4), mask);
+        __m128i index[2] = { _mm_unpacklo_epi8(lo, hi), _mm_unpackhi_epi8(lo, hi) };
+        
+        for (unsigned k = 0; k < 2; k++) {
+            
+            // Look up each byte of 16 colors and interleave the bytes
+            __m128i b0 = _mm_shuffle_epi8(plane0, index[k]);
+            __m128i b1 = _mm_shuffle_epi8(plane1, index[k]);
+            __m128i b2 = _mm_shuffle_epi8(plane2, index[k]);
+            __m128i b3 = _mm_shuffle_epi8(plane3, index[k]);
+            __m128i lo01 = _mm_unpacklo_epi8(b0, b1);
+            __m128i hi01 = _mm_unpackhi_epi8(b0, b1);
+            __m128i lo23 = _mm_unpacklo_epi8(b2, b3);
+            __m128i hi23 = _mm_unpackhi_epi8(b2, b3);
+            
+            __m128i *target = (__m128i *)(out + i + 16 * k);
+            _mm_storeu_si128(target, _mm_unpacklo_epi16(lo01, lo23));
+            _mm_storeu_si128(target + 1, _mm_unpackhi_epi16(lo01, lo23));
+            _mm_storeu_si128(target + 2, _mm_unpacklo_epi16(hi01, hi23));
+            _mm_storeu_si128(target + 3, _mm_unpackhi_epi16(hi01, hi23));
+        }
+    }
+    expandScalar(in, out + i, count - i, palette);
+}
+
+#endif
+
+#ifdef INDEXED_NEON
+
+static void
+expandNEON(const uint8_t *in, uint32_t *out, size_t count, const uint32_t *palette)
+{
+    // Byte n of all colors, indexed by the color number
+    uint8_t bytes[4][16];
+    for (unsigned i = 0; i < 16; i++) {
+        for (unsigned n = 0; n < 4; n++) bytes[n][i] = (uint8_t)(palette[i] >> (8 * n));
+    }
+    uint8x16_t plane0 = vld1q_u8(bytes[0]);
+    uint8x16_t plane1 = vld1q_u8(bytes[1]);
+    uint8x16_t plane2 = vld1q_u8(bytes[2]);
+    uint8x16_t plane3 = vld1q_u8(bytes[3]);
+    
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32, in += 16) {
+        
+        // Split the nibbles into 32 indices in pixel order
+        uint8x16_t packed = vld1q_u8(in);
+        uint8x16x2_t index = vzipq_u8(vandq_u8(packed, vdupq_n_u8(0x0F)), vshrq_n_u8(packed, 4));
+        
+        for (unsigned k = 0; k < 2; k++) {
+            
+            // Look up each byte of 16 colors and store them interleaved
+            uint8x16x4_t rgba;
+            rgba.val[0] = vqtbl1q_u8(plane0, index.val[k]);
+            rgba.val[1] = vqtbl1q_u8(plane1, index.val[k]);
+            rgba.val[2] = vqtbl1q_u8(plane2, index.val[k]);
+            rgba.val[3] = vqtbl1q_u8(plane3, index.val[k]);
+            vst4q_u8((uint8_t *)(out + i + 16 * k), rgba);
+        }
+    }
+    expandScalar(in, out + i, count - i, palette);
+}
+
+#endif
+
+// Returns the index of the palette entry closest to 'color'
+static uint8_t
+closestColor(uint32_t color, const uint32_t palette[16])
+{
+    uint8_t best = 0;
+    long bestDistance = LONG_MAX;
+    
+    for (unsigned i = 0; i < 16; i++) {
+        
+        long distance = 0;
+        for (unsigned n = 0; n < 24; n += 8) {
+            long delta = (long)((color >> n) & 0xFF) - (long)((palette[i] >> n) & 0xFF);
+            distance += delta * delta;
+        }
+        if (distance < bestDistance) {
+            bestDistance = distance;
+            best = (uint8_t)i;
+        }
+    }
+    return best;
+}
+
+IndexedFrame::IndexedFrame()
+{
+    setKernel(bestKernel());
+}
+
+void
+IndexedFrame::resize(unsigned width, unsigned height)
+{
+    this->width = width;
+    this->height = height;
+    pitch = (width + 1) / 2;
+    pixels.assign(pitch * height, 0);
+}
+
+void
+IndexedFrame::pack(const uint32_t *rgba, const uint32_t palette[16])
+{
+    packLines(rgba, 0, height, palette);
+}
+
+void
+IndexedFrame::packLines(const uint32_t *rgba, unsigned first, unsigned count, const uint32_t palette[16])
+{
+    // Map colors to indices with a small direct-mapped cache
+    uint32_t cachedColor[64];
+    uint8_t cachedIndex[64];
+    auto slot = [](uint32_t color) { return (color * 0x9E3779B1u) >> 26; };
+    
+    for (unsigned i = 0; i < 64; i++) {
+        cachedColor[i] = palette[0];
+        cachedIndex[i] = 0;
+    }
+    for (uint8_t i = 16; i-- > 0;) {
+        cachedColor[slot(palette[i])] = palette[i];
+        cachedIndex[slot(palette[i])] = i;
+    }
+    
+    auto indexOf = [&](uint32_t color) {
+        
+        uint32_t s = slot(color);
+        if (cachedColor[s] != color) {
+            
+            // Colliding palette entries and foreign colors end up here
+            uint8_t index = 16;
+            for (uint8_t i = 0; i < 16 && index == 16; i++) {
+                if (palette[i] == color) index = i;
+            }
+            cachedColor[s] = color;
+            cachedIndex[s] = index < 16 ? index : closestColor(color, palette);
+        }
+        return cachedIndex[s];
+    };
+    
+    for (unsigned y = first; y < first + count && y < height; y++) {
+        
+        const uint32_t *in = rgba + (size_t)y * width;
+        uint8_t *out = pixels.data() + y * pitch;
+        
+        unsigned x = 0;
+        for (; x + 1 < width; x += 2) {
+            *out++ = indexOf(in[x]) | (uint8_t)(indexOf(in[x + 1]) << 4);
+        }
+        if (x < width) *out = indexOf(in[x]);
+    }
+}
+
+void
+IndexedFrame::expand(uint32_t *rgba, const uint32_t palette[16]) const
+{
+    expandLines(rgba, 0, height, palette);
+}
+
+void
+IndexedFrame::expandLines(uint32_t *rgba, unsigned first, unsigned count, const uint32_t palette[16]) const
+{
+    for (unsigned y = first; y < first + count && y < height; y++) {
+        expandRow(pixels.data() + y * pitch, rgba + (size_t)y * width, width, palette);
+    }
+}
+
+bool
+IndexedFrame::isSupported(Kernel kernel)
+{
+    switch (kernel) {
+            
+        case KERNEL_SCALAR:
+            return true;
+            
+#ifdef INDEXED_X86
+        case KERNEL_SSSE3:
+            return __builtin_cpu_supports("ssse3");
+#endif
+            
+#ifdef INDEXED_NEON
+        case KERNEL_NEON:
+            return true;
+#endif
+            
+        default:
+            return false;
+    }
+}
+
+IndexedFrame::Kernel
+IndexedFrame::bestKernel()
+{
+    if (isSupported(KERNEL_NEON)) return KERNEL_NEON;
+    if (isSupported(KERNEL_SSSE3)) return KERNEL_SSSE3;
+    return KERNEL_SCALAR;
+}
+
+const char *
+IndexedFrame::kernelName(Kernel kernel)
+{
+    switch (kernel) {
+        case KERNEL_SCALAR: return "scalar";
+        case KERNEL_SSSE3: return "SSSE3";
+        case KERNEL_NEON: return "NEON";
+    }
+    return "?";
+}
+
+bool
+IndexedFrame::setKernel(Kernel kernel)
+{
+    if (!isSupported(kernel)) return false;
+    
+    switch (kernel) {
+            
+#ifdef INDEXED_X86
+        case KERNEL_SSSE3: expandRow = expandSSSE3; break;
+#endif
+#ifdef INDEXED_NEON
+        case KERNEL_NEON: expandRow = expandNEON; break;
+#endif
+        default: expandRow = expandScalar; break;
+    }
+    this->kernel = kernel;
+    return true;
+}
@@ -0,0 +1,103 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _INDEXEDFRAME_INC
+#define _INDEXEDFRAME_INC
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* A frame stored as 4-bit color indices.
+ * VIC only ever draws the 16 colors of its palette, so a frame fits into
+ * half a byte per pixel, an eighth of its RGBA texture. Two pixels share a
+ * byte, the left one in the lower nibble. A frame is converted back to RGBA
+ * with any palette, so palette changes apply to stored frames as well. The
+ * expansion looks up 16 pixels at once with SSSE3 (pshufb) or NEON (tbl).
+ */
+class IndexedFrame {
+    
+public:
+    
+    enum Kernel {
+        KERNEL_SCALAR = 0,
+        KERNEL_SSSE3,
+        KERNEL_NEON
+    };
+    
+private:
+    
+    // Size of the frame in pixels
+    unsigned width = 0;
+    unsigned height = 0;
+    
+    // Number of bytes per line
+    size_t pitch = 0;
+    
+    // Color indices (two pixels per byte)
+    std::vector<uint8_t> pixels;
+    
+    // Expands 'count' pixels of a line
+    void (*expandRow)(const uint8_t *in, uint32_t *out, size_t count, const uint32_t *palette);
+    Kernel kernel;
+    
+public:
+    
+    IndexedFrame();
+    
+    void resize(unsigned width, unsigned height);
+    
+    unsigned getWidth() const { return width; }
+    unsigned getHeight() const { return height; }
+    size_t getPitch() const { return pitch; }
+    
+    // Returns the packed indices and their size in bytes
+    const uint8_t *data() const { return pixels.data(); }
+    size_t size() const { return pixels.size(); }
+    
+    /* Converts lines of an RGBA texture of the same size into indices.
+     * 'rgba' points to the start of the texture. Colors that aren't part of
+     * 'palette' are mapped to the closest palette entry.
+     */
+    void pack(const uint32_t *rgba, const uint32_t palette[16]);
+    void packLines(const uint32_t *rgba, unsigned first, unsigned count, const uint32_t palette[16]);
+    
+    // Converts lines back into an RGBA texture of the same size
+    void expand(uint32_t *rgba, const uint32_t palette[16]) const;
+    void expandLines(uint32_t *rgba, unsigned first, unsigned count, const uint32_t palette[16]) const;
+    
+    
+    //
+    // Selecting the expansion kernel
+    //
+    
+    static bool isSupported(Kernel kernel);
+    static Kernel bestKernel();
+    static const char *kernelName(Kernel kernel);
+    
+    Kernel getKernel() const { return kernel; }
+    bool setKernel(Kernel kernel);
+};
+
+#endif
@@ -0,0 +1,169 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "InputMovie.h"
+#include "Varint.h"
+#include <cstdio>
+#include <cstring>
+
+static const char movieMagic[4] = { 'V', 'C', 'M', 'V' };
+static const uint64_t movieVersion = 3;
+
+bool
+InputMovie::hasText(InputEventType type)
+{
+    switch (type) {
+            
+        case INPUT_TEXT:
+        case INPUT_CARTRIDGE:
+        case INPUT_TAPE:
+        case INPUT_DISK:
+        case INPUT_AUTOSTART:
+        case INPUT_STATE:
+            return true;
+            
+        default:
+            return false;
+    }
+}
+
+uint64_t
+InputMovie::hashState(const uint8_t *state, size_t size)
+{
+    uint64_t h = 0xcbf29ce484222325;
+    
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ state[i]) * 0x100000001b3;
+    }
+    return h;
+}
+
+void
+InputMovie::encode(std::vector<uint8_t> &data) const
+{
+    data.assign(movieMagic, movieMagic + sizeof(movieMagic));
+    putVarint(data, movieVersion);
+    putVarint(data, frames);
+    putVarint(data, finalHash);
+    putVarint(data, drivePowerSaving ? 1 : 0);
+    putVarint(data, startState.size());
+    data.insert(data.end(), startState.begin(), startState.end());
+    putVarint(data, events.size());
+    
+    uint64_t frame = 0, cycle = 0;
+    
+    for (const Event &e : events) {
+        
+        putVarint(data, e.frame - frame);
+        putVarint(data, e.cycle - cycle);
+        data.push_back(e.type);
+        data.push_back(e.arg1);
+        data.push_back(e.arg2);
+        if (hasText(e.type)) {
+            putVarint(data, e.text.size());
+            data.insert(data.end(), e.text.begin(), e.text.end());
+        }
+        frame = e.frame;
+        cycle = e.cycle;
+    }
+}
+
+bool
+InputMovie::decode(const uint8_t *data, size_t size)
+{
+    const uint8_t *p = data, *end = data + size;
+    uint64_t version, stateSize, count, frame = 0, cycle = 0;
+    
+    if (size < sizeof(movieMagic) || memcmp(p, movieMagic, sizeof(movieMagic)) != 0) return false;
+    p += sizeof(movieMagic);
+    
+    if (!getVarint(p, end, version) || version == 0 || version > movieVersion) return false;
+    if (!getVarint(p, end, frames) || !getVarint(p, end, finalHash)) return false;
+    
+    uint64_t powerSaving = 0;
+    if (version >= 3 && !getVarint(p, end, powerSaving)) return false;
+    drivePowerSaving = powerSaving != 0;
+    
+    if (!getVarint(p, end, stateSize) || stateSize > (uint64_t)(end - p)) return false;
+    
+    startState.assign(p, p + stateSize);
+    p += stateSize;
+    
+    if (!getVarint(p, end, count)) return false;
+    events.clear();
+    
+    for (uint64_t i = 0; i < count; i++) {
+        
+        Event e;
+        uint64_t frameDelta, cycleDelta, length;
+        
+        if (!getVarint(p, end, frameDelta) || !getVarint(p, end, cycleDelta)) return false;
+        if (end - p < 3) return false;
+        
+        e.frame = frame += frameDelta;
+        e.cycle = cycle += cycleDelta;
+        e.type = (InputEventType)*p++;
+        e.arg1 = *p++;
+        e.arg2 = *p++;
+        
+        if (hasText(e.type)) {
+            if (!getVarint(p, end, length) || length > (uint64_t)(end - p)) return false;
+            e.text.assign((const char *)p, (size_t)length);
+            p += length;
+        }
+        events.push_back(e);
+    }
+    return true;
+}
+
+bool
+InputMovie::writeToFile(const char *path) const
+{
+    std::vector<uint8_t> data;
+    encode(data);
+    
+    FILE *file = fopen(path, "wb");
+    if (file == nullptr) return false;
+    
+    bool result = fwrite(data.data(), 1, data.size(), file) == data.size();
+    return fclose(file) == 0 && result;
+}
+
+bool
+InputMovie::readFromFile(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) return false;
+    
+    std::vector<uint8_t> data;
+    uint8_t chunk[65536];
+    size_t count;
+    
+    while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + count);
+    }
+    fclose(file);
+    
+    return decode(data.data(), data.size());
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _INPUTMOVIE_INC
+#define _INPUTMOVIE_INC
+
+#include "FrameDriver_types.h"
+#include <string>
+#include <vector>
+
+/* Recording of all input sent to a FrameDriver.
+ * A movie consists of the state the recording started with, the list of
+ * input events, and the number of frames and a hash of the state at the end
+ * of the recording. Every event is stamped with the frame it was applied in
+ * and the CPU cycle at that time, both relative to the start state. Replaying
+ * the events on top of the start state must reproduce the final state bit by
+ * bit.
+ *
+ * File format (all integers are variable length encoded, see Varint.h):
+ *
+ *     "VCMV" version frames finalHash powerSaving stateSize state[stateSize]
+ *     eventCount { frameDelta cycleDelta type arg1 arg2 [length text] } ...
+ *
+ * The text is only present for text, media and state events. A state event
+ * carries a complete state written by FrameDriver::saveState(). Version 2
+ * added state and reset events, version 3 the drive power saving flag.
+ */
+class InputMovie {
+    
+public:
+    
+    struct Event {
+        uint64_t frame;
+        uint64_t cycle;
+        InputEventType type;
+        uint8_t arg1;
+        uint8_t arg2;
+        std::string text;
+    };
+    
+    // State of the machine when the recording started (see FrameDriver::saveState())
+    std::vector<uint8_t> startState;
+    
+    // Recorded events in the order they were applied
+    std::vector<Event> events;
+    
+    // Number of frames recorded
+    uint64_t frames = 0;
+    
+    // Hash of the state at the end of the recording
+    uint64_t finalHash = 0;
+    
+    // Drive power saving of the recording (see FrameDriver::setDrivePowerSaving())
+    bool drivePowerSaving = false;
+    
+    // Checks if an event carries a text or a path
+    static bool hasText(InputEventType type);
+    
+    // Computes the hash value used for finalHash
+    static uint64_t hashState(const uint8_t *state, size_t size);
+    
+    // Converts the movie into its binary representation and back
+    void encode(std::vector<uint8_t> &data) const;
+    bool decode(const uint8_t *data, size_t size);
+    
+    bool writeToFile(const char *path) const;
+    bool readFromFile(const char *path);
+};
+
+#endif
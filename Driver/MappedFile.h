@@ -0,0 +1,64 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _MAPPEDFILE_INC
+#define _MAPPEDFILE_INC
+
+#include <cstddef>
+#include <cstdint>
+
+/* A file mapped into memory for reading.
+ * Type checks and hashes read the mapping directly, and pages are only read
+ * once they are accessed. The core still copies the data when an archive,
+ * cartridge, tape or ROM is created from the mapping with makeWithBuffer().
+ * Mapping only saves the temporary buffer the file was read into before.
+ * The mapping is private and read-only and is removed when the object is
+ * destroyed.
+ */
+class MappedFile {
+    
+    void *base = nullptr;
+    size_t length = 0;
+    
+public:
+    
+    MappedFile() { }
+    explicit MappedFile(const char *path) { open(path); }
+    ~MappedFile() { close(); }
+    
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    
+    // Maps a file (returns false if the file is empty or can't be mapped)
+    bool open(const char *path);
+    
+    // Removes the mapping
+    void close();
+    
+    bool isOpen() const { return base != nullptr; }
+    const uint8_t *data() const { return (const uint8_t *)base; }
+    size_t size() const { return length; }
+};
+
+#endif
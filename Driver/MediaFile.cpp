@@ -0,0 +1,138 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "MediaFile.h"
+#include <cstring>
+#include <strings.h>
+
+// Checks if a path ends with a suffix (ignoring case)
+static bool
+hasSuffix(const char *path, const char *suffix)
+{
+    size_t length = strlen(path), suffixLength = strlen(suffix);
+    return length >= suffixLength && strcasecmp(path + length - suffixLength, suffix) == 0;
+}
+
+bool
+MediaFile::open(const char *path)
+{
+    this->path = path;
+    fileType = UNKNOWN_FILE_FORMAT;
+    
+    if (!file.open(path)) return false;
+    
+    fileType = sniff(path, file.data(), file.size());
+    return true;
+}
+
+C64FileType
+MediaFile::sniff(const char *path, const uint8_t *data, size_t size)
+{
+    if (CRTFile::isSupportedCRTBuffer(data, size)) return CRT_FILE;
+    if (TAPFile::isTAPBuffer(data, size)) return TAP_FILE;
+    if (G64File::isG64Buffer(data, size)) return G64_FILE;
+    if (D64File::isD64Buffer(data, size)) return D64_FILE;
+    if (T64File::isT64Buffer(data, size)) return T64_FILE;
+    if (P00File::isP00Buffer(data, size)) return P00_FILE;
+    if (hasSuffix(path, ".prg") && PRGFile::isPRGBuffer(data, size)) return PRG_FILE;
+    
+    if (ROMFile::isBasicRomBuffer(data, size)) return BASIC_ROM_FILE;
+    if (ROMFile::isKernalRomBuffer(data, size)) return KERNAL_ROM_FILE;
+    if (ROMFile::isCharRomBuffer(data, size)) return CHAR_ROM_FILE;
+    if (ROMFile::isVC1541RomBuffer(data, size)) return VC1541_ROM_FILE;
+    
+    return UNKNOWN_FILE_FORMAT;
+}
+
+MediaType
+MediaFile::getMediaType() const
+{
+    switch (fileType) {
+            
+        case CRT_FILE: return MEDIA_CARTRIDGE;
+        case TAP_FILE: return MEDIA_TAPE;
+        case G64_FILE:
+        case D64_FILE:
+        case T64_FILE:
+        case P00_FILE:
+        case PRG_FILE: return MEDIA_ARCHIVE;
+        default: return MEDIA_UNKNOWN;
+    }
+}
+
+bool
+MediaFile::isRom() const
+{
+    return (fileType == BASIC_ROM_FILE || fileType == KERNAL_ROM_FILE ||
+            fileType == CHAR_ROM_FILE || fileType == VC1541_ROM_FILE);
+}
+
+AnyArchive *
+MediaFile::makeArchive() const
+{
+    AnyArchive *archive;
+    
+    switch (fileType) {
+            
+        case G64_FILE: archive = G64File::makeWithBuffer(data(), size()); break;
+        case D64_FILE: archive = D64File::makeWithBuffer(data(), size()); break;
+        case T64_FILE: archive = T64File::makeWithBuffer(data(), size()); break;
+        case P00_FILE: archive = P00File::makeWithBuffer(data(), size()); break;
+        case PRG_FILE: archive = PRGFile::makeWithBuffer(data(), size()); break;
+        default: return nullptr;
+    }
+    
+    if (archive) archive->setPath(getPath());
+    return archive;
+}
+
+CRTFile *
+MediaFile::makeCartridge() const
+{
+    if (fileType != CRT_FILE) return nullptr;
+    
+    CRTFile *crt = CRTFile::makeWithBuffer(data(), size());
+    if (crt) crt->setPath(getPath());
+    return crt;
+}
+
+TAPFile *
+MediaFile::makeTape() const
+{
+    if (fileType != TAP_FILE) return nullptr;
+    
+    TAPFile *tap = TAPFile::makeWithBuffer(data(), size());
+    if (tap) tap->setPath(getPath());
+    return tap;
+}
+
+ROMFile *
+MediaFile::makeRom() const
+{
+    if (!isRom()) return nullptr;
+    
+    ROMFile *rom = ROMFile::makeWithBuffer(data(), size());
+    if (rom) rom->setPath(getPath());
+    return rom;
+}
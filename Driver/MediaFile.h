@@ -0,0 +1,77 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _MEDIAFILE_INC
+#define _MEDIAFILE_INC
+
+#include "C64.h"
+#include "FrameDriver_types.h"
+#include "MappedFile.h"
+#include <string>
+
+/* A media or ROM file that is read only once.
+ * The file is mapped when it is opened, and its type is determined from the
+ * mapped bytes. The emulator objects are built from the same bytes, so
+ * identifying a file and attaching it doesn't open the file again. Like the
+ * makeWithFile() functions of the core, PRG files are only recognized by
+ * their suffix, because any buffer passes as a program.
+ */
+class MediaFile {
+    
+    std::string path;
+    MappedFile file;
+    C64FileType fileType = UNKNOWN_FILE_FORMAT;
+    
+public:
+    
+    MediaFile() { }
+    explicit MediaFile(const char *path) { open(path); }
+    
+    // Maps a file and determines its type (returns false if it can't be read)
+    bool open(const char *path);
+    
+    bool isOpen() const { return file.isOpen(); }
+    const char *getPath() const { return path.c_str(); }
+    const uint8_t *data() const { return file.data(); }
+    size_t size() const { return file.size(); }
+    
+    // Returns the type of the file
+    C64FileType getFileType() const { return fileType; }
+    MediaType getMediaType() const;
+    bool isRom() const;
+    
+    /* Builds the emulator object for the file.
+     * The caller owns the object. NULL is returned if the file is of a
+     * different type.
+     */
+    AnyArchive *makeArchive() const;
+    CRTFile *makeCartridge() const;
+    TAPFile *makeTape() const;
+    ROMFile *makeRom() const;
+    
+    // Determines the type of a file from its path and contents
+    static C64FileType sniff(const char *path, const uint8_t *data, size_t size);
+};
+
+#endif
@@ -0,0 +1,164 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "RewindBuffer.h"
+#include "Varint.h"
+#include <cstring>
+
+static inline uint64_t
+load64(const uint8_t *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+RewindBuffer::RewindBuffer(size_t budget, unsigned keyframeInterval)
+: budget(budget), keyframeInterval(keyframeInterval ? keyframeInterval : 1)
+{
+}
+
+void
+RewindBuffer::setBudget(size_t bytes)
+{
+    budget = bytes;
+    enforceBudget();
+}
+
+void
+RewindBuffer::clear()
+{
+    entries.clear();
+    latest.clear();
+    used = 0;
+    sinceKeyframe = 0;
+}
+
+void
+RewindBuffer::push(const uint8_t *state, size_t size)
+{
+    Entry entry;
+    
+    // Store a keyframe periodically and whenever the state size changes
+    entry.keyframe = entries.empty() || size != latest.size() || sinceKeyframe >= keyframeInterval;
+    
+    if (entry.keyframe) {
+        entry.data.assign(state, state + size);
+        sinceKeyframe = 0;
+    } else {
+        encodeDelta(latest.data(), state, size, entry.data);
+        entry.data.shrink_to_fit();
+        sinceKeyframe++;
+    }
+    
+    latest.assign(state, state + size);
+    used += entry.data.size();
+    entries.push_back(std::move(entry));
+    
+    enforceBudget();
+}
+
+bool
+RewindBuffer::restore(size_t age, std::vector<uint8_t> &state)
+{
+    if (age >= entries.size()) return false;
+    
+    size_t target = entries.size() - 1 - age;
+    
+    // Start at the closest keyframe and replay the deltas
+    size_t key = target;
+    while (!entries[key].keyframe) key--;
+    
+    state = entries[key].data;
+    for (size_t i = key + 1; i <= target; i++) applyDelta(entries[i].data, state);
+    
+    // Discard the future
+    while (entries.size() > target + 1) {
+        used -= entries.back().data.size();
+        entries.pop_back();
+    }
+    latest = state;
+    sinceKeyframe = (unsigned)(target - key);
+    return true;
+}
+
+void
+RewindBuffer::enforceBudget()
+{
+    while (used > budget) {
+        
+        // Find the second keyframe, i.e., the end of the oldest group
+        size_t end = 1;
+        while (end < entries.size() && !entries[end].keyframe) end++;
+        
+        // Always keep the latest group
+        if (end == entries.size()) break;
+        
+        for (size_t i = 0; i < end; i++) {
+            used -= entries.front().data.size();
+            entries.pop_front();
+        }
+    }
+}
+
+void
+RewindBuffer::encodeDelta(const uint8_t *from, const uint8_t *to, size_t size,
+                          std::vector<uint8_t> &delta)
+{
+    size_t i = 0;
+    
+    delta.clear();
+    
+    while (i < size) {
+        
+        // Skip unchanged bytes, eight at a time where possible
+        size_t start = i;
+        while (i + 8 <= size && load64(from + i) == load64(to + i)) i += 8;
+        while (i < size && from[i] == to[i]) i++;
+        if (i == size) break;
+        
+        // Collect changed bytes until two unchanged bytes in a row show up
+        size_t first = i;
+        while (i < size && (from[i] != to[i] || (i + 1 < size && from[i + 1] != to[i + 1]))) i++;
+        
+        putVarint(delta, first - start);
+        putVarint(delta, i - first);
+        for (size_t j = first; j < i; j++) delta.push_back(from[j] ^ to[j]);
+    }
+}
+
+void
+RewindBuffer::applyDelta(const std::vector<uint8_t> &delta, std::vector<uint8_t> &state)
+{
+    const uint8_t *p = delta.data();
+    const uint8_t *end = p + delta.size();
+    uint8_t *dst = state.data();
+    
+    while (p < end) {
+        
+        dst += getVarint(p);
+        size_t count = (size_t)getVarint(p);
+        for (size_t i = 0; i < count; i++) *dst++ ^= *p++;
+    }
+}
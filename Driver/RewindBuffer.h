@@ -0,0 +1,107 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _REWINDBUFFER_INC
+#define _REWINDBUFFER_INC
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+/* Ring buffer of recent machine states.
+ * Every few states, a full copy (a keyframe) is stored. All other states are
+ * stored as the XOR difference to their predecessor, encoded as alternating
+ * runs of unchanged and changed bytes. Since only a small part of the machine
+ * changes from frame to frame, a delta is usually a few hundred bytes. If the
+ * buffer exceeds its byte budget, the oldest keyframe is dropped together with
+ * all deltas depending on it.
+ */
+class RewindBuffer {
+    
+    struct Entry {
+        bool keyframe;
+        std::vector<uint8_t> data;
+    };
+    
+    // Stored states, oldest first
+    std::deque<Entry> entries;
+    
+    // Copy of the latest state (the base for the next delta)
+    std::vector<uint8_t> latest;
+    
+    // Maximum number of bytes occupied by all entries
+    size_t budget;
+    
+    // Number of bytes currently occupied by all entries
+    size_t used = 0;
+    
+    // A keyframe is stored after this number of deltas
+    unsigned keyframeInterval;
+    
+    // Number of deltas stored since the latest keyframe
+    unsigned sinceKeyframe = 0;
+    
+public:
+    
+    RewindBuffer(size_t budget = 32 * 1024 * 1024, unsigned keyframeInterval = 30);
+    
+    size_t getBudget() const { return budget; }
+    void setBudget(size_t bytes);
+    
+    unsigned getKeyframeInterval() const { return keyframeInterval; }
+    void setKeyframeInterval(unsigned value) { keyframeInterval = value ? value : 1; }
+    
+    // Deletes all states
+    void clear();
+    
+    // Adds a state
+    void push(const uint8_t *state, size_t size);
+    
+    /* Reconstructs a state and deletes all newer states.
+     * 'age' counts the pushes back from the latest state (0 = latest).
+     * Reconstruction decodes at most keyframeInterval deltas.
+     */
+    bool restore(size_t age, std::vector<uint8_t> &state);
+    
+    // Returns the number of states stored
+    size_t count() const { return entries.size(); }
+    
+    // Returns the number of bytes occupied by all states
+    size_t bytesUsed() const { return used; }
+    
+private:
+    
+    // Drops the oldest keyframe and its deltas until the budget is met
+    void enforceBudget();
+    
+    // Encodes the XOR difference of two states of equal size
+    static void encodeDelta(const uint8_t *from, const uint8_t *to, size_t size,
+                            std::vector<uint8_t> &delta);
+    
+    // Applies an encoded difference to a state
+    static void applyDelta(const std::vector<uint8_t> &delta, std::vector<uint8_t> &state);
+};
+
+#endif
@@ -0,0 +1,92 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "RomRegistry.h"
+#include <sys/stat.h>
+
+RomRegistry &
+RomRegistry::shared()
+{
+    static RomRegistry registry;
+    return registry;
+}
+
+std::shared_ptr<const RomRegistry::Image>
+RomRegistry::get(const std::string &path)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) return nullptr;
+    
+    std::lock_guard<std::mutex> guard(lock);
+    
+    auto it = paths.find(path);
+    if (it != paths.end() &&
+        it->second.fileSize == (int64_t)info.st_size &&
+        it->second.fileTime == (int64_t)info.st_mtime) {
+        
+        auto image = images.find(it->second.fingerprint);
+        if (image != images.end()) return image->second;
+    }
+    
+    std::shared_ptr<Image> image = std::make_shared<Image>();
+    reads++;
+    
+    if (!image->file.open(path.c_str()) || !image->file.isRom()) {
+        paths.erase(path);
+        return nullptr;
+    }
+    
+    // Hash the bytes like the core hashes a flashed ROM
+    image->fingerprint = fnv_1a_64((uint8_t *)image->file.data(), image->file.size());
+    paths[path] = { (int64_t)info.st_size, (int64_t)info.st_mtime, image->fingerprint };
+    
+    // Keep the first mapping of an image found at several paths
+    auto known = images.find(image->fingerprint);
+    if (known != images.end()) return known->second;
+    
+    images[image->fingerprint] = image;
+    return image;
+}
+
+void
+RomRegistry::clear()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    paths.clear();
+    images.clear();
+}
+
+size_t
+RomRegistry::count()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return images.size();
+}
+
+long
+RomRegistry::getReads()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return reads;
+}
@@ -0,0 +1,90 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _ROMREGISTRY_INC
+#define _ROMREGISTRY_INC
+
+#include "MediaFile.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/* Process-wide lookup cache of ROM images.
+ * When many emulator instances run in one process, each of them used to open
+ * and validate the same ROM files. The registry maps, validates and
+ * fingerprints every file once. Images are keyed by the fingerprint the core
+ * computes for a flashed ROM (see C64Memory::kernalRomFingerprint()), so
+ * identical images found at different paths are kept only once, and an
+ * instance can tell if it already holds an image. Flashing still copies the
+ * image into each instance. The files stay mapped until clear() is called,
+ * and a file that changes on disk is read again.
+ */
+class RomRegistry {
+    
+public:
+    
+    struct Image {
+        MediaFile file;
+        
+        // Computed like the fingerprint the core reports for a flashed ROM
+        uint64_t fingerprint;
+    };
+    
+private:
+    
+    // Size and modification time of a file when it was read
+    struct Entry {
+        int64_t fileSize;
+        int64_t fileTime;
+        uint64_t fingerprint;
+    };
+    
+    std::mutex lock;
+    std::map<std::string, Entry> paths;
+    std::map<uint64_t, std::shared_ptr<const Image>> images;
+    
+    // Number of files read
+    long reads = 0;
+    
+public:
+    
+    // Returns the registry shared by all instances
+    static RomRegistry &shared();
+    
+    /* Returns the image stored in a file.
+     * Returns NULL if the file can't be read or doesn't contain a ROM. The
+     * image stays valid as long as the returned pointer is held, even if the
+     * registry is cleared.
+     */
+    std::shared_ptr<const Image> get(const std::string &path);
+    
+    // Forgets all images and removes the mappings not held elsewhere
+    void clear();
+    
+    size_t count();
+    long getReads();
+};
+
+#endif
@@ -0,0 +1,135 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "SampleRing.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// Size of a cache line on all supported hosts
+static const size_t cacheLine = 64;
+
+SampleRing::SampleRing(size_t capacity)
+{
+    this->capacity = 1;
+    while (this->capacity < capacity) this->capacity <<= 1;
+    
+    allocation = malloc(this->capacity * sizeof(float) + cacheLine);
+    if (allocation == nullptr) throw std::bad_alloc();
+    
+    uintptr_t aligned = ((uintptr_t)allocation + cacheLine - 1) & ~(uintptr_t)(cacheLine - 1);
+    buffer = (float *)aligned;
+    memset(buffer, 0, this->capacity * sizeof(float));
+}
+
+SampleRing::~SampleRing()
+{
+    free(allocation);
+}
+
+size_t
+SampleRing::count() const
+{
+    return head.value.load(std::memory_order_acquire) - tail.value.load(std::memory_order_acquire);
+}
+
+unsigned
+SampleRing::writeSpans(Span spans[2])
+{
+    size_t h = head.value.load(std::memory_order_relaxed);
+    size_t free = capacity - (h - tail.value.load(std::memory_order_acquire));
+    size_t start = h & (capacity - 1);
+    size_t first = std::min(free, capacity - start);
+    
+    spans[0] = { buffer + start, first };
+    spans[1] = { buffer, free - first };
+    return free == 0 ? 0 : free == first ? 1 : 2;
+}
+
+float *
+SampleRing::writeSpan(size_t count)
+{
+    Span spans[2];
+    
+    writeSpans(spans);
+    return spans[0].count >= count ? spans[0].data : nullptr;
+}
+
+void
+SampleRing::commitWrite(size_t count)
+{
+    head.value.store(head.value.load(std::memory_order_relaxed) + count, std::memory_order_release);
+}
+
+size_t
+SampleRing::write(const float *samples, size_t count)
+{
+    Span spans[2];
+    size_t written = 0;
+    
+    for (unsigned i = 0, n = writeSpans(spans); i < n && written < count; i++) {
+        
+        size_t chunk = std::min(spans[i].count, count - written);
+        memcpy(spans[i].data, samples + written, chunk * sizeof(float));
+        written += chunk;
+    }
+    commitWrite(written);
+    return written;
+}
+
+unsigned
+SampleRing::readSpans(Span spans[2])
+{
+    size_t t = tail.value.load(std::memory_order_relaxed);
+    size_t available = head.value.load(std::memory_order_acquire) - t;
+    size_t start = t & (capacity - 1);
+    size_t first = std::min(available, capacity - start);
+    
+    spans[0] = { buffer + start, first };
+    spans[1] = { buffer, available - first };
+    return available == 0 ? 0 : available == first ? 1 : 2;
+}
+
+void
+SampleRing::commitRead(size_t count)
+{
+    tail.value.store(tail.value.load(std::memory_order_relaxed) + count, std::memory_order_release);
+}
+
+size_t
+SampleRing::read(float *samples, size_t count)
+{
+    Span spans[2];
+    size_t copied = 0;
+    
+    for (unsigned i = 0, n = readSpans(spans); i < n && copied < count; i++) {
+        
+        size_t chunk = std::min(spans[i].count, count - copied);
+        memcpy(samples + copied, spans[i].data, chunk * sizeof(float));
+        copied += chunk;
+    }
+    commitRead(copied);
+    return copied;
+}
@@ -0,0 +1,128 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _SAMPLERING_INC
+#define _SAMPLERING_INC
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/* Lock-free ring buffer of audio samples for one producer and one consumer.
+ * Instead of copying sample by sample, both sides access the buffer through
+ * spans, i.e., pointers to the contiguous regions that can be written or
+ * read. Free space and available samples are split into at most two spans
+ * when they wrap around the end of the buffer. The producer publishes
+ * samples with commitWrite(), the consumer releases them with commitRead().
+ * The storage starts at a cache line boundary. Each position is padded to
+ * the size of a cache line, so that the producer's and the consumer's
+ * position don't share a line. The positions themselves are not aligned,
+ * and a position may share a line with the members in front of it.
+ */
+class SampleRing {
+    
+public:
+    
+    struct Span {
+        float *data;
+        size_t count;
+    };
+    
+private:
+    
+    // A position padded to the size of a cache line
+    struct Index {
+        std::atomic<size_t> value { 0 };
+        char padding[64 - sizeof(std::atomic<size_t>)];
+    };
+    
+    // Storage (cache line aligned) and its unaligned allocation
+    float *buffer = nullptr;
+    void *allocation = nullptr;
+    
+    // Number of samples the buffer holds (a power of two)
+    size_t capacity = 0;
+    
+    // Number of samples written by the producer and read by the consumer
+    Index head;
+    Index tail;
+    
+public:
+    
+    // Creates a ring holding at least 'capacity' samples
+    explicit SampleRing(size_t capacity = 16384);
+    ~SampleRing();
+    
+    SampleRing(const SampleRing &) = delete;
+    SampleRing &operator=(const SampleRing &) = delete;
+    
+    size_t getCapacity() const { return capacity; }
+    
+    // Returns the number of samples waiting to be read
+    size_t count() const;
+    
+    // Returns the ratio of waiting samples and the capacity
+    double fillLevel() const { return (double)count() / capacity; }
+    
+    
+    //
+    // Producer side
+    //
+    
+    /* Returns the free space as up to two spans.
+     * Returns the number of spans, which is 0 if the buffer is full.
+     */
+    unsigned writeSpans(Span spans[2]);
+    
+    /* Returns a single span of 'count' free samples.
+     * Returns NULL if the free space doesn't contain enough contiguous
+     * samples, e.g., because it wraps around the end of the buffer.
+     */
+    float *writeSpan(size_t count);
+    
+    // Publishes 'count' samples written into the free space
+    void commitWrite(size_t count);
+    
+    // Copies samples into the buffer and returns the number of samples copied
+    size_t write(const float *samples, size_t count);
+    
+    
+    //
+    // Consumer side
+    //
+    
+    // Returns the waiting samples as up to two spans (see writeSpans())
+    unsigned readSpans(Span spans[2]);
+    
+    // Releases 'count' samples after they have been consumed
+    void commitRead(size_t count);
+    
+    // Copies samples out of the buffer and returns the number of samples copied
+    size_t read(float *samples, size_t count);
+    
+    // Discards all waiting samples
+    void clear() { commitRead(count()); }
+};
+
+#endif
@@ -0,0 +1,527 @@
+// Copyright (c) 2020, OpenEmu Team
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the OpenEmu Team nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY OpenEmu Team ''AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL OpenEmu Team BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Headless throughput benchmark
+//
+// Usage: vc64bench [-r romdir] [-b bootframes] [-f frames] [-t buffers] [-d] [-c cachedir] [-k text] [-a] [-w factor] [-R] [-A frames] [-n instances] [-j threads] [-M movie] [-m movie] [-P frames] [-p] [-D mode] [-o factor] [-S] [-T] [-I] [-L] file ...
+//
+// Every file is run in a freshly powered up C64. The machine first boots for
+// the given number of frames, then the file is attached and the driver runs
+// the measured number of frames. Per file and in total, the tool reports
+// frames per second, emulated CPU cycles per second and per-frame latency
+// percentiles. With -t, every frame is presented in a ring of host buffers
+// (2 = double, 3 = triple buffering). Without it, frames are consumed in place.
+// With -d, the driver tracks modified lines and the tool reports the share of
+// lines that changed. With -c, the boot process is skipped if the cache
+// directory contains a snapshot of the READY prompt. Otherwise, a snapshot is
+// stored after booting. With -k, the given text is typed after the file has
+// been attached (e.g. -k 'load"*",8,1\n'). With -a, archives holding a single
+// program are started directly instead of being inserted into the drive.
+// While the drive or datasette is busy, the driver warps by the factor given
+// with -w (0 disables warping). The reported frame rate counts emulated frames.
+// With -R, every frame is recorded in the rewind buffer and the tool reports
+// the memory needed per frame and the time needed to go back one second.
+// With -A, the driver runs the given number of frames ahead. With -p, drives
+// that are not needed are switched off. With -D, drive 1 is emulated in the
+// given mode (0 = cycle exact, 1 = fast head, 2 = high-level). With -o, SID
+// samples at the given multiple of the host rate and the driver filters the
+// output down.
+//
+// With -T, the samples are filtered on an audio thread, which takes the
+// filter off the emulation thread. The tool reports the samples delivered by
+// that thread and the blocks it had to drop.
+//
+// With -S, the tool measures the cost of audio instead of running files. The
+// first file (if any) is run once per SID sampling method and once with
+// oversampling, and the time per frame and the extra time per sample compared
+// to SID_SAMPLE_FAST are reported. Then, the decimation filter is timed on
+// its own with each convolution kernel the host supports.
+//
+// With -n, the first file is run in the given number of instances in parallel
+// on a pool of -j threads (default: one per core), and the aggregate frame
+// rate is reported. Comparing different thread counts shows how well the
+// emulator scales.
+//
+// With -M, all input after booting is recorded into the given movie file,
+// including the attached file and the typed text. With -m, a movie is replayed
+// at maximum speed instead of running files. The tool reports the frame rate
+// and whether the final state matches the recording.
+//
+// With -P, the driver's profiling counters are printed every given number of
+// frames. They show the cycles executed by the C64 and both drives and the
+// host time spent emulating, handling input, audio, video, rewinding and
+// running ahead.
+
+#include "FrameDriver.h"
+#include "BatchRunner.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchResult {
+    
+    uint64_t frames = 0;
+    uint64_t cycles = 0;
+    uint64_t lines = 0;
+    uint64_t dirtyLines = 0;
+    double seconds = 0;
+    std::vector<double> latencies; // Microseconds per frame
+};
+
+static double
+percentile(std::vector<double> &v, double p)
+{
+    if (v.empty()) return 0;
+    size_t i = std::min(v.size() - 1, (size_t)(p * (v.size() - 1) + 0.5));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+static void
+report(const char *name, BenchResult &r)
+{
+    printf("%-32s %8.1f fps %8.2f MHz  p50 %7.1f  p90 %7.1f  p99 %7.1f  max %7.1f us\n",
+           name,
+           r.frames / r.seconds,
+           r.cycles / r.seconds / 1e6,
+           percentile(r.latencies, 0.50),
+           percentile(r.latencies, 0.90),
+           percentile(r.latencies, 0.99),
+           percentile(r.latencies, 1.00));
+    
+    if (r.lines) {
+        printf("%-32s %8.1f %% dirty lines\n", "", 100.0 * r.dirtyLines / r.lines);
+    }
+}
+
+struct BenchOptions {
+    
+    std::string romDir = ".";
+    std::string cacheDir;
+    std::string text;
+    unsigned bootFrames = 180;
+    unsigned frames = 3000;
+    unsigned buffers = 0;
+    unsigned warpFactor = 8;
+    bool dirty = false;
+    bool autostart = false;
+    bool rewind = false;
+    unsigned runAhead = 0;
+    unsigned instances = 0;
+    unsigned threads = 0;
+    std::string recordPath;
+    std::string replayPath;
+    unsigned profileInterval = 0;
+    bool powerSaving = false;
+    DriveMode driveMode = DRIVE_CYCLE_EXACT;
+    unsigned oversampling = 1;
+    bool audioBench = false;
+    bool audioThread = false;
+    bool indexed = false;
+    bool lazyInsert = false;
+};
+
+// Replaces the escape sequence \n by a newline character
+static std::string
+unescape(const char *s)
+{
+    std::string result;
+    
+    for (; *s; s++) {
+        if (s[0] == '\\' && s[1] == 'n') { result.push_back('\n'); s++; }
+        else result.push_back(*s);
+    }
+    return result;
+}
+
+// Configures a driver, loads the ROMs and powers up the machine
+static bool
+powerUp(FrameDriver &driver, const BenchOptions &opt, const char *path)
+{
+    std::string failed;
+    
+    bool tape = path && MediaFile(path).getFileType() == TAP_FILE;
+    
+    driver.configure();
+    if (!driver.loadRoms(opt.romDir, !tape, &failed)) {
+        fprintf(stderr, "%s is not a valid ROM\n", failed.c_str());
+        return false;
+    }
+    driver.powerUp();
+    driver.setDrivePowerSaving(opt.powerSaving);
+    driver.setDriveMode(opt.driveMode);
+    driver.setLazyDiskInsert(opt.lazyInsert);
+    if (!opt.cacheDir.empty()) driver.setDiskCacheDirectory(opt.cacheDir);
+    driver.setAudioOversampling(opt.oversampling);
+    driver.setWarpLoad(opt.warpFactor != 0);
+    driver.setWarpFactor(opt.warpFactor);
+    return true;
+}
+
+// Attaches or starts a file and types the requested text
+static bool
+attach(FrameDriver &driver, const BenchOptions &opt, const char *path)
+{
+    bool started = path && opt.autostart && driver.autostart(path);
+    
+    if (path && !started && !driver.attachMedia(path)) {
+        fprintf(stderr, "Cannot attach %s\n", path);
+        return false;
+    }
+    if (!opt.text.empty()) driver.typeText(opt.text);
+    return true;
+}
+
+static bool
+runFile(const BenchOptions &opt, const char *path, BenchResult &total)
+{
+    unsigned frames = opt.frames;
+    unsigned buffers = opt.buffers;
+    bool dirty = opt.dirty;
+    
+    FrameDriver driver;
+    std::vector<std::vector<uint32_t>> hostBuffers(buffers);
+    std::vector<uint32_t *> hostBufferPtrs;
+    
+    if (!powerUp(driver, opt, path)) return false;
+    
+    for (auto &buffer : hostBuffers) {
+        buffer.resize(driver.frameWidth() * driver.frameHeight());
+        hostBufferPtrs.push_back(buffer.data());
+    }
+    driver.setExternalFrameBuffers(hostBufferPtrs.data(), buffers);
+    driver.setDirtyTracking(dirty);
+    driver.setIndexedOutput(opt.indexed);
+    
+    auto bootStart = Clock::now();
+    
+    if (opt.cacheDir.empty() || !driver.restoreBootSnapshot(opt.cacheDir)) {
+        
+        for (unsigned i = 0; i < opt.bootFrames; i++) driver.executeFrame();
+        if (!opt.cacheDir.empty()) driver.saveBootSnapshot(opt.cacheDir);
+    }
+    
+    double bootTime = std::chrono::duration<double, std::milli>(Clock::now() - bootStart).count();
+    
+    InputMovie movie;
+    if (!opt.recordPath.empty()) driver.startRecording(movie);
+    
+    if (!attach(driver, opt, path)) return false;
+    driver.setRewindRecording(opt.rewind);
+    driver.setRunAhead(opt.runAhead);
+    driver.setProfiling(opt.profileInterval != 0);
+    
+    std::atomic<uint64_t> threadSamples { 0 };
+    if (opt.audioThread) {
+        driver.setAudioSink([&threadSamples](const float *samples, size_t count) {
+            threadSamples += count;
+        });
+    }
+    
+    BenchResult r;
+    r.latencies.reserve(frames);
+    uint64_t cycle = driver.c64->cpu.cycle;
+    uint64_t frame = driver.frameCount();
+    auto start = Clock::now();
+    
+    for (unsigned i = 0; i < frames; i++) {
+        
+        auto t0 = Clock::now();
+        driver.executeFrame();
+        driver.swapFrameBuffers();
+        driver.audioOutput().clear();
+        auto t1 = Clock::now();
+        r.latencies.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+        
+        if (dirty) {
+            r.lines += driver.frameHeight();
+            r.dirtyLines += driver.dirtyLineCount();
+        }
+        if (opt.profileInterval && (i + 1) % opt.profileInterval == 0) {
+            driver.dumpProfile();
+            driver.resetProfile();
+        }
+    }
+    
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    r.frames = driver.frameCount() - frame;
+    r.cycles = driver.c64->cpu.cycle - cycle;
+    report(path ? path : "(no media)", r);
+    printf("%-32s %8.1f ms boot\n", "", bootTime);
+    printf("%-32s %8ld audio underruns %8ld overruns\n", "",
+           driver.audioUnderruns(), driver.audioOverruns());
+    
+    if (opt.audioThread) {
+        
+        long dropped = driver.droppedAudioBlocks();
+        driver.setAudioSink(nullptr);
+        printf("%-32s %8llu samples from the audio thread, %ld blocks dropped\n", "",
+               (unsigned long long)threadSamples.load(), dropped);
+    }
+    
+    // Without recorded states (e.g., -f 0), there is nothing to report
+    if (opt.rewind && driver.getRewindBuffer().count() > 0) {
+        
+        RewindBuffer &buffer = driver.getRewindBuffer();
+        size_t states = buffer.count();
+        size_t bytes = buffer.bytesUsed();
+        unsigned age = (unsigned)std::min(states - 1, (size_t)60);
+        
+        auto t0 = Clock::now();
+        driver.rewind(age);
+        double us = std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+        
+        printf("%-32s %8zu states %8.1f KB/frame  %8.1f us to rewind %u frames\n", "",
+               states, bytes / 1024.0 / states, us, age);
+    }
+    
+    if (driver.isRecording()) {
+        
+        driver.stopRecording();
+        if (!movie.writeToFile(opt.recordPath.c_str())) {
+            fprintf(stderr, "Cannot write %s\n", opt.recordPath.c_str());
+            return false;
+        }
+        printf("%-32s %8zu events recorded in %s\n", "", movie.events.size(), opt.recordPath.c_str());
+    }
+    
+    total.frames += r.frames;
+    total.cycles += r.cycles;
+    total.seconds += r.seconds;
+    total.lines += r.lines;
+    total.dirtyLines += r.dirtyLines;
+    total.latencies.insert(total.latencies.end(), r.latencies.begin(), r.latencies.end());
+    return true;
+}
+
+// Replays a movie in warp mode and checks the final state
+static bool
+runMovie(const BenchOptions &opt)
+{
+    const char *path = opt.replayPath.c_str();
+    FrameDriver driver;
+    InputMovie movie;
+    
+    if (!movie.readFromFile(path)) {
+        fprintf(stderr, "%s is not a valid movie\n", path);
+        return false;
+    }
+    if (!powerUp(driver, opt, nullptr) || !driver.startReplay(movie)) {
+        fprintf(stderr, "Cannot restore the start state of %s\n", path);
+        return false;
+    }
+    
+    driver.setWarp(true);
+    driver.setWarpFactor(std::max(opt.warpFactor, 1u));
+    
+    uint64_t cycle = driver.c64->cpu.cycle;
+    uint64_t frame = driver.frameCount();
+    auto start = Clock::now();
+    
+    while (driver.isReplaying()) driver.executeFrame();
+    
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    printf("%-32s %8.1f fps %8.2f MHz  %llu frames, %zu events, %ld desyncs, final state %s\n",
+           path,
+           (driver.frameCount() - frame) / seconds,
+           (driver.c64->cpu.cycle - cycle) / seconds / 1e6,
+           (unsigned long long)movie.frames,
+           movie.events.size(),
+           driver.replayDesyncs(),
+           driver.replayVerified() ? "matches" : "DIFFERS");
+    return driver.replayVerified();
+}
+
+// Measures the cost of the SID sampling methods and the decimation filter
+static bool
+runAudioBench(const BenchOptions &opt, const char *path)
+{
+    struct Variant {
+        const char *name;
+        SamplingMethod method;
+        unsigned oversampling;
+    };
+    static const Variant variants[] = {
+        { "SID_SAMPLE_FAST", SID_SAMPLE_FAST, 1 },
+        { "SID_SAMPLE_INTERPOLATE", SID_SAMPLE_INTERPOLATE, 1 },
+        { "SID_SAMPLE_RESAMPLE", SID_SAMPLE_RESAMPLE, 1 },
+        { "SID_SAMPLE_RESAMPLE_FASTMEM", SID_SAMPLE_RESAMPLE_FASTMEM, 1 },
+        { "SID_SAMPLE_FAST, 4x oversampling", SID_SAMPLE_FAST, 4 }
+    };
+    double baseline = 0;
+    
+    for (const Variant &variant : variants) {
+        
+        BenchOptions options = opt;
+        options.oversampling = variant.oversampling;
+        
+        FrameDriver driver;
+        if (!powerUp(driver, options, path)) return false;
+        driver.c64->sid.setSamplingMethod(variant.method);
+        
+        for (unsigned i = 0; i < opt.bootFrames; i++) driver.executeFrame();
+        if (!attach(driver, options, path)) return false;
+        
+        uint64_t samples = 0;
+        auto start = Clock::now();
+        
+        for (unsigned i = 0; i < opt.frames; i++) {
+            driver.executeFrame();
+            samples += driver.audioSampleCount();
+            driver.audioOutput().clear();
+        }
+        
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        if (&variant == variants) baseline = ns;
+        
+        printf("%-36s %8.1f us/frame %8.1f ns/sample extra\n", variant.name,
+               ns / opt.frames / 1000.0, samples ? (ns - baseline) / samples : 0.0);
+    }
+    
+    // Time the decimation filter on its own
+    std::vector<float> in(44100 * 4), out(44100);
+    for (size_t i = 0; i < in.size(); i++) in[i] = (float)sin(i * 0.01);
+    
+    for (int k = FirDecimator::KERNEL_SCALAR; k <= FirDecimator::KERNEL_NEON; k++) {
+        
+        FirDecimator decimator;
+        if (!decimator.setKernel((FirDecimator::Kernel)k)) continue;
+        decimator.configure(4);
+        
+        size_t samples = 0;
+        auto start = Clock::now();
+        for (int i = 0; i < 20; i++) {
+            samples += decimator.process(in.data(), in.size(), out.data(), out.size());
+        }
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        
+        printf("%-36s %8.1f ns/sample\n",
+               (std::string("4x decimation, ") + FirDecimator::kernelName((FirDecimator::Kernel)k)).c_str(),
+               ns / samples);
+    }
+    return true;
+}
+
+// Runs many instances of the same file in parallel
+static bool
+runBatch(const BenchOptions &opt, const char *path)
+{
+    BatchRunner runner(opt.threads);
+    
+    for (unsigned i = 0; i < opt.instances; i++) {
+        if (!powerUp(runner.addInstance(), opt, path)) return false;
+    }
+    runner.run(opt.bootFrames);
+    
+    for (unsigned i = 0; i < opt.instances; i++) {
+        if (!attach(runner.instance(i), opt, path)) return false;
+    }
+    BatchStats stats = runner.run(opt.frames);
+    
+    printf("%-32s %8.1f fps %8.2f MHz  %zu instances on %u threads (%.1f fps each), %llu steals\n",
+           path ? path : "(no media)",
+           stats.frames / stats.seconds,
+           stats.cycles / stats.seconds / 1e6,
+           stats.instances, stats.threads,
+           stats.frames / stats.seconds / stats.instances,
+           (unsigned long long)stats.steals);
+    return true;
+}
+
+int
+main(int argc, char *argv[])
+{
+    BenchOptions opt;
+    int c;
+    
+    while ((c = getopt(argc, argv, "r:b:f:t:dc:k:aw:RA:n:j:M:m:P:pD:o:STIL")) != -1) {
+        
+        switch (c) {
+                
+            case 'r': opt.romDir = optarg; break;
+            case 'b': opt.bootFrames = (unsigned)atoi(optarg); break;
+            case 'f': opt.frames = (unsigned)atoi(optarg); break;
+            case 't': opt.buffers = (unsigned)atoi(optarg); break;
+            case 'd': opt.dirty = true; break;
+            case 'c': opt.cacheDir = optarg; break;
+            case 'k': opt.text = unescape(optarg); break;
+            case 'a': opt.autostart = true; break;
+            case 'w': opt.warpFactor = (unsigned)atoi(optarg); break;
+            case 'R': opt.rewind = true; break;
+            case 'A': opt.runAhead = (unsigned)atoi(optarg); break;
+            case 'n': opt.instances = (unsigned)atoi(optarg); break;
+            case 'j': opt.threads = (unsigned)atoi(optarg); break;
+            case 'M': opt.recordPath = optarg; break;
+            case 'm': opt.replayPath = optarg; break;
+            case 'P': opt.profileInterval = (unsigned)atoi(optarg); break;
+            case 'p': opt.powerSaving = true; break;
+            case 'D': opt.driveMode = (DriveMode)atoi(optarg); break;
+            case 'o': opt.oversampling = (unsigned)atoi(optarg); break;
+            case 'S': opt.audioBench = true; break;
+            case 'T': opt.audioThread = true; break;
+            case 'I': opt.indexed = true; break;
+            case 'L': opt.lazyInsert = true; break;
+            default:
+                fprintf(stderr, "Usage: %s [-r romdir] [-b bootframes] [-f frames] [-t buffers] [-d] [-c cachedir] [-k text] [-a] [-w factor] [-R] [-A frames] [-n instances] [-j threads] [-M movie] [-m movie] [-P frames] [-p] [-D mode] [-o factor] [-S] [-T] [-I] [-L] file ...\n", argv[0]);
+                return 1;
+        }
+    }
+    
+    BenchResult total;
+    bool success = true;
+    
+    if (opt.audioBench) {
+        
+        success &= runAudioBench(opt, optind < argc ? argv[optind] : nullptr);
+        return success ? 0 : 1;
+    }
+    
+    if (!opt.replayPath.empty()) {
+        
+        success &= runMovie(opt);
+        return success ? 0 : 1;
+    }
+    
+    if (opt.instances) {
+        
+        success &= runBatch(opt, optind < argc ? argv[optind] : nullptr);
+        return success ? 0 : 1;
+    }
+    
+    if (optind == argc) {
+        success &= runFile(opt, nullptr, total);
+    }
+    for (int i = optind; i < argc; i++) {
+        success &= runFile(opt, argv[i], total);
+    }
+    
+    if (total.frames) report("TOTAL", total);
+    return success ? 0 : 1;
+}
@@ -26,6 +26,8 @@
 
 #import "VC64GameCore.h"
 #import "C64.h"
+#import "FrameDriver.h"
+#import "RomRegistry.h"
 #import "C64Proxy+Private.h"
 #import "OEC64SystemResponderClient.h"
 #import "VirtualC64-Swift.h"
@@ -33,19 +35,19 @@
 #import <OpenGL/gl.h>
 #import <Carbon/Carbon.h>
 #import <OpenEmuBase/OERingBuffer.h>
-
-#define SOUNDBUFFERSIZE 2048
+#include <atomic>
 
 @interface VC64GameCore () <OEC64SystemResponderClient>
 {
+    FrameDriver *driver;
     C64 *c64;
     C64Proxy *_proxy;
     KeyboardController *_kbd;
     BOOL                _isJoystickPortSwapped;
     NSString *_fileToLoad;
-    float    *_soundBuffer;
     uint32_t *_videoBuffer;
-    BOOL      _didRUN;
+    // Read by the audio thread of the driver as well
+    std::atomic<bool> _didRUN;
     
     //  Used to tell the system that the C64 has finished loading and is ready for interaction
     BOOL      isC64Ready;
@@ -54,18 +56,34 @@
     BOOL      isAtReadyPrompt;
     BOOL      waitingForReady;
     
-    //  Used to make sure we don't send more text if it is in the process of auto typing already
-    BOOL      isStillTyping;
+    // Trap latched by the driver when the Kernal starts waiting for keyboard input
+    unsigned  inputTrap;
     
     //Controls weather we have loaded the game or still in the process of doing so
     BOOL      isGameLoading;
     BOOL      isGameLoaded;
+    
+    // Indicates that a snapshot of the READY prompt exists for this configuration
+    BOOL      hasBootSnapshot;
+    
+    // Set while the user holds the rewind button
+    BOOL      isRewindRequested;
+    
+    // Input movie recorded while the game is running
+    InputMovie *movie;
+    
+    // The game file, read once and kept while the game is loaded
+    MediaFile *media;
 }
 
 - (void)typeText:(NSString *)text;
 - (void)typeText:(NSString *)text withDelay:(int)delay;
 - (void)checkForReady;
 - (BOOL)loadBIOSRoms;
+- (NSString *)bootSnapshotDirectory;
+- (BOOL)restoreBootSnapshot;
+- (NSString *)diskCacheDirectory;
+- (void)didLoadState;
 @end
 
 @implementation VC64GameCore
@@ -74,16 +92,24 @@
 {
     if((self = [super init]))
     {
-        c64     = new C64();
+        driver  = new FrameDriver();
+        c64     = driver->c64;
+        driver->setDirtyTracking(true);
+        driver->setRewindRecording(true);
+        driver->setDrivePowerSaving(true);
+        
+        // Optionally serve disks without emulating the 1541 (see DriveMode)
+        driver->setDriveMode((DriveMode)[[NSUserDefaults standardUserDefaults] integerForKey:@"VC64DriveMode"]);
+        driver->setLazyDiskInsert([[NSUserDefaults standardUserDefaults] boolForKey:@"VC64LazyDiskInsert"]);
+        
+        inputTrap = driver->addInputTrap();
         _proxy  = [[C64Proxy alloc] initWithC64:c64];
+        [_proxy setFrameDriver:driver];
         _kbd    = [[KeyboardController alloc] initWithC64:_proxy];
 
-        _soundBuffer = (float *)calloc(SOUNDBUFFERSIZE, sizeof(*_soundBuffer));
-
         isC64Ready      = false;
         isAtReadyPrompt = false;
         waitingForReady = false;
-        isStillTyping   = false;
         isGameLoading   = false;
         isGameLoaded    = false;
     }
@@ -93,7 +119,9 @@
 
 - (void)dealloc
 {
-    free(_soundBuffer);
+    delete movie;
+    delete media;
+    delete driver;
 }
 
 #pragma mark - Execution
@@ -101,60 +129,100 @@
 - (BOOL)loadFileAtPath:(NSString *)path
 {
     _fileToLoad = [path copy];
+    
+    delete media;
+    media = new MediaFile(_fileToLoad.fileSystemRepresentation);
 
-    // System
     // TODO: Determine region
-    c64->vic.setModel(NTSC_6567);
+    driver->configure(NTSC_6567);
     
     if(![self loadBIOSRoms])
         return NO;
 
-    // Peripherals
-    c64->setAlwaysWarp(false);
-    // c64->setWarp(false);
-    c64->setWarpLoad(false); // Leave disabled otherwise audio can get slightly out of sync
-    c64->drive1.setSendSoundMessages(false);
-    // c64->drive1.setBitAccuracy(true); // Disable to put drive in a faster, but less compatible read-only mode
-
-    // Audio
-    c64->sid.setReSID(true);
-    c64->sid.setModel(MOS_6581); // MOS6581 or MOS8580
-    c64->sid.setSamplingMethod(SID_SAMPLE_FAST);
-    c64->sid.setAudioFilter(false);
-
     return YES;
 }
 
 - (void)setupEmulation
 {
     // Power on sub components
-    c64->sid.run();
-    c64->cpu.clearErrorState();
-    c64->drive1.cpu.clearErrorState();
-    c64->drive2.cpu.clearErrorState();
-    c64->restartTimer();
+    driver->powerUp();
+    
+    // Skip the boot process if the READY prompt has been cached before
+    [self restoreBootSnapshot];
+    
+    // Optionally keep encoded disks for the next launch
+    if ([[NSUserDefaults standardUserDefaults] boolForKey:@"VC64DiskCache"])
+        driver->setDiskCacheDirectory([self diskCacheDirectory].fileSystemRepresentation);
+    
+    // Optionally let SID sample at a multiple of the host rate for cleaner audio
+    driver->setAudioOversampling((unsigned)[[NSUserDefaults standardUserDefaults] integerForKey:@"VC64AudioOversampling"]);
+    
+    // Optionally filter the samples on a separate thread
+    if ([[NSUserDefaults standardUserDefaults] boolForKey:@"VC64AudioThread"])
+    {
+        VC64GameCore * __unsafe_unretained core = self;
+        driver->setAudioSink([core](const float *samples, size_t count) {
+            if (core->_didRUN)
+                [[core audioBufferAtIndex:0] write:samples maxLength:count * sizeof(float)];
+        });
+    }
+    
+    // Optionally hide the input lag of games by running ahead
+    driver->setRunAhead((unsigned)[[NSUserDefaults standardUserDefaults] integerForKey:@"VC64RunAheadFrames"]);
+    
+    // Optionally record all input for replaying the session in vc64bench
+    if ([[NSUserDefaults standardUserDefaults] stringForKey:@"VC64InputMovieDirectory"])
+    {
+        movie = new InputMovie();
+        driver->startRecording(*movie);
+    }
 }
 
 - (void)executeFrame
 {
+    if (isRewindRequested)
+    {
+        // Go back two frames and emulate one to get a picture of the state
+        if (driver->rewind(2))
+        {
+            driver->executeFrame();
+            driver->swapFrameBuffers();
+        }
+        
+        // Drop the audio of the rewound frames instead of letting it pile up
+        driver->audioOutput().clear();
+        return;
+    }
+    
     // Run the game loop ourselves
-    int samples = c64->sid.getSampleRate() / c64->vic.getFramesPerSecond();
-
-    c64->executeOneFrame();
+    driver->executeFrame();
+    
+    // present the new frame in the host's video buffer
+    driver->swapFrameBuffers();
     
-    // copy video buffer
-    memcpy(_videoBuffer, c64->vic.screenBuffer(), self.bufferSize.width * self.bufferSize.height * sizeof(uint32_t));
+    // Copy the new samples straight out of the driver's ring
+    SampleRing &ring = driver->audioOutput();
+    SampleRing::Span spans[2];
+    unsigned spanCount = ring.readSpans(spans);
     
-    if(_didRUN)
+    if(_didRUN && !driver->hasAudioSink())
     {
-        c64->sid.readMonoSamples(_soundBuffer, samples);
-        [[self audioBufferAtIndex:0] write:_soundBuffer maxLength:samples * sizeof(*_soundBuffer)];
+        for (unsigned i = 0; i < spanCount; i++)
+            [[self audioBufferAtIndex:0] write:spans[i].data maxLength:spans[i].count * sizeof(float)];
     }
-    else
+    ring.commitRead(spans[0].count + spans[1].count);
+    
+    if(!_didRUN || driver->hasAudioSink())
     {
         if (!isC64Ready)
         {
             [self checkForReady];  //this is called every Execute frame C64 if not at ready prompt.
+            
+            if (isC64Ready && !hasBootSnapshot)
+            {
+                // Cache the READY prompt to speed up the next launch
+                hasBootSnapshot = driver->saveBootSnapshot([self bootSnapshotDirectory].fileSystemRepresentation);
+            }
         }
         else
         {
@@ -167,12 +235,13 @@
             }
             else
             {
-                if(isGameLoaded && !_didRUN && !isStillTyping)
+                if(isGameLoaded && !_didRUN && !driver->isTyping())
                 {
                     if (!waitingForReady )
                     {
                         isAtReadyPrompt=false;
                         waitingForReady=true;
+                        driver->consumeTrap(inputTrap);
                     }
                     if (!isAtReadyPrompt)
                     {
@@ -191,17 +260,35 @@
 
 - (void)resetEmulation
 {
-    c64->cpu.reset();
     isC64Ready=false;
     isAtReadyPrompt=false;
     isGameLoaded=false;
     isGameLoading=false;
     waitingForReady=false;
+    driver->consumeTrap(inputTrap);
     _didRUN = NO;
+    
+    driver->cancelTyping();
+    if (![self restoreBootSnapshot])
+        driver->reset();
 }
 
 - (void)stopEmulation
 {
+    if (movie)
+    {
+        driver->stopRecording();
+        
+        NSString *directory = [[NSUserDefaults standardUserDefaults] stringForKey:@"VC64InputMovieDirectory"];
+        NSString *name = [[[_fileToLoad lastPathComponent] stringByDeletingPathExtension] stringByAppendingPathExtension:@"vcmv"];
+        NSString *path = [directory stringByAppendingPathComponent:name];
+        
+        [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:nil];
+        if (!movie->writeToFile(path.fileSystemRepresentation))
+            NSLog(@"VirtualC64: Cannot write input movie %@", path);
+    }
+    
+    driver->setAudioSink(nullptr);
     c64->halt();
     isC64Ready=false;
     isAtReadyPrompt=false;
@@ -218,20 +305,27 @@
     return c64->vic.getFramesPerSecond();
 }
 
-// Doesn't seem to work correctly, audio still goes out of sync
-// Use setWarp instead of Always warp
+// Warp is handled by the driver which keeps the audio output at nominal rate
 -(void)fastForward:(BOOL)flag
 {
-   // flag ? c64->setWarp(true) : c64->setWarp(false);
-    
-    [super fastForward:flag];
+    driver->setWarp(flag);
+}
+
+// Rewinding is done by the driver which keeps delta compressed states of the recent frames
+- (void)rewind:(BOOL)flag
+{
+    isRewindRequested = flag;
 }
 
 
 #pragma mark - Video
 
 - (const void*)getVideoBufferWithHint:(void *)hint {
-    _videoBuffer = static_cast<uint32_t *>(hint);
+    if (hint != NULL && hint != _videoBuffer)
+    {
+        _videoBuffer = static_cast<uint32_t *>(hint);
+        driver->setExternalFrameBuffers(&_videoBuffer, 1);
+    }
     return hint;
 }
 
@@ -269,7 +363,7 @@
 
 - (double)audioSampleRate
 {
-    return c64->sid.getSampleRate();
+    return driver->sampleRate();
 }
 
 - (NSUInteger)audioBitDepth
@@ -286,18 +380,56 @@
 
 - (void)saveStateToFileAtPath:(NSString *)fileName completionHandler:(void (^)(BOOL, NSError *))block
 {
-    c64->takeUserSnapshotSafe();
-    auto nr = c64->numUserSnapshots() - 1;
-    auto saveState = c64->userSnapshot(nr);
-    block(saveState->writeToFile(fileName.fileSystemRepresentation),nil);
-    c64->deleteUserSnapshot(nr);
+    block(driver->saveStateToFile(fileName.fileSystemRepresentation), nil);
 }
 
 - (void)loadStateFromFileAtPath:(NSString *)fileName completionHandler:(void (^)(BOOL, NSError *))block
 {
-    Snapshot *saveState = new Snapshot;
-    block(saveState->readFromFile(fileName.fileSystemRepresentation),nil);
-    c64->loadFromSnapshotSafe(saveState);
+    BOOL success = driver->loadStateFromFile(fileName.fileSystemRepresentation);
+    if (success)
+        [self didLoadState];
+    
+    block(success, nil);
+}
+
+- (NSData *)serializeStateWithError:(NSError **)outError
+{
+    NSMutableData *data = [NSMutableData dataWithLength:driver->stateSize()];
+    size_t size = driver->saveState((uint8_t *)data.mutableBytes, data.length);
+    
+    if (size == 0)
+    {
+        if (outError)
+            *outError = [NSError errorWithDomain:OEGameCoreErrorDomain code:OEGameCoreCouldNotSaveStateError userInfo:nil];
+        return nil;
+    }
+    
+    data.length = size;
+    return data;
+}
+
+- (BOOL)deserializeState:(NSData *)state withError:(NSError **)outError
+{
+    if (!driver->loadState((const uint8_t *)state.bytes, state.length))
+    {
+        if (outError)
+            *outError = [NSError errorWithDomain:OEGameCoreErrorDomain code:OEGameCoreCouldNotLoadStateError userInfo:nil];
+        return NO;
+    }
+    
+    [self didLoadState];
+    return YES;
+}
+
+// A loaded state is a running game, so there is nothing left to load or type
+- (void)didLoadState
+{
+    driver->cancelTyping();
+    isC64Ready      = true;
+    isAtReadyPrompt = true;
+    isGameLoading   = false;
+    isGameLoaded    = true;
+    _didRUN         = YES;
 }
 
 #pragma mark - Input
@@ -347,46 +479,45 @@
 
 - (oneway void)didPushC64Button:(OEC64Button)button forPlayer:(NSUInteger)player;
 {
-    ControlPort *port;
+    unsigned port;
     switch (player) {
-        case 1:port = _isJoystickPortSwapped ?  &c64->port1:  &c64->port2;
-        case 2:port = _isJoystickPortSwapped ?  &c64->port2 :  &c64->port1;
+        case 1: port = _isJoystickPortSwapped ? 1 : 2; break;
+        case 2: port = _isJoystickPortSwapped ? 2 : 1; break;
         default: return;
     }
     
-    if(button == OEC64JoystickUp)    { port->trigger(PULL_UP); }
-    if(button == OEC64JoystickDown)  { port->trigger(PULL_DOWN); }
-    if(button == OEC64JoystickLeft)  { port->trigger(PULL_LEFT); }
-    if(button == OEC64JoystickRight) { port->trigger(PULL_RIGHT); }
-    if(button == OEC64ButtonFire)    { port->trigger(PRESS_FIRE); }
+    if(button == OEC64JoystickUp)    { driver->joystickEvent(port, PULL_UP); }
+    if(button == OEC64JoystickDown)  { driver->joystickEvent(port, PULL_DOWN); }
+    if(button == OEC64JoystickLeft)  { driver->joystickEvent(port, PULL_LEFT); }
+    if(button == OEC64JoystickRight) { driver->joystickEvent(port, PULL_RIGHT); }
+    if(button == OEC64ButtonFire)    { driver->joystickEvent(port, PRESS_FIRE); }
     
 }
 
 - (oneway void)didReleaseC64Button:(OEC64Button)button forPlayer:(NSUInteger)player;
 {
-    ControlPort *port;
+    unsigned port;
     
     switch (player) {
-        case 1:port = _isJoystickPortSwapped ?  &c64->port1:  &c64->port2;
-        case 2:port = _isJoystickPortSwapped ?  &c64->port2 :  &c64->port1;
+        case 1: port = _isJoystickPortSwapped ? 1 : 2; break;
+        case 2: port = _isJoystickPortSwapped ? 2 : 1; break;
         default: return;
     }
     
     switch (button) {
         case OEC64JoystickUp:
         case OEC64JoystickDown:
-            port->trigger(RELEASE_Y);
+            driver->joystickEvent(port, RELEASE_Y);
             break;
             
         case OEC64JoystickLeft:
         case OEC64JoystickRight:
-            port->trigger(RELEASE_X);
+            driver->joystickEvent(port, RELEASE_X);
             break;
             
         case OEC64ButtonFire:
-            port->trigger(RELEASE_FIRE);
+            driver->joystickEvent(port, RELEASE_FIRE);
             break;
-            
         default:
             break;
     }
@@ -401,54 +532,45 @@
 
 - (BOOL)loadBIOSRoms
 {
-    // Get The 4 BIOS ROMs
+    // Get The 4 BIOS ROMs (Basic, Kernal, Char and C1541 Floppy)
+    // JiffyDOS is preferred unless a tape is loaded, which it cannot handle
+    std::string failedRom;
+    BOOL jiffyDOS = media->getFileType() != TAP_FILE;
     
-    // BASIC ROM
-    NSString *basicROM = [[self biosDirectoryPath] stringByAppendingPathComponent:@"basic.901226-01.bin"];
-    if (!ROMFile::isBasicRomFile(basicROM.UTF8String))
+    if (!driver->loadRoms([self biosDirectoryPath].fileSystemRepresentation, jiffyDOS, &failedRom))
     {
-        NSLog(@"VirtualC64: %@ is not a valid Basic ROM!", basicROM);
+        NSLog(@"VirtualC64: %s is not a valid ROM!", failedRom.c_str());
         return NO;
     }
     
-    // "Kernal" ROM
-    NSString *kernelROM = [[self biosDirectoryPath] stringByAppendingPathComponent:@"JiffyDOS_C64.bin"];
-    if (!ROMFile::isKernalRomFile(kernelROM.UTF8String) || TAPFile::isTAPFile(_fileToLoad.UTF8String))
-    {
-       kernelROM = [[self biosDirectoryPath] stringByAppendingPathComponent:@"kernal.901227-03.bin"];
-        if (!ROMFile::isKernalRomFile(kernelROM.UTF8String))
-        {
-            NSLog(@"VirtualC64: %@ is not a valid Kernal ROM!", kernelROM);
-            return NO;
-        }
-    }
+    // The core runs a single instance, so there is nothing to reuse the mappings for
+    RomRegistry::shared().clear();
     
-    // Char ROM
-    NSString *charROM = [[self biosDirectoryPath] stringByAppendingPathComponent:@"characters.901225-01.bin"];
-    if (!ROMFile::isCharRomFile(charROM.UTF8String))
-    {
-        NSLog(@"VirtualC64: %@ is not a valid Char ROM!", charROM);
+    return YES;
+}
+
+- (NSString *)bootSnapshotDirectory
+{
+    NSString *path = [[self supportDirectoryPath] stringByAppendingPathComponent:@"Boot Snapshots"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:path withIntermediateDirectories:YES attributes:nil error:nil];
+    return path;
+}
+
+- (NSString *)diskCacheDirectory
+{
+    NSString *path = [[self supportDirectoryPath] stringByAppendingPathComponent:@"Disk Cache"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:path withIntermediateDirectories:YES attributes:nil error:nil];
+    return path;
+}
+
+- (BOOL)restoreBootSnapshot
+{
+    if (!driver->restoreBootSnapshot([self bootSnapshotDirectory].fileSystemRepresentation))
         return NO;
-    }
-    
-    // C1541 aka Floppy ROM
-    NSString *C1541ROM = [[self biosDirectoryPath] stringByAppendingPathComponent:@"JiffyDOS_C1541.bin"];
-    if (!ROMFile::isVC1541RomFile(C1541ROM.UTF8String))
-    {
-         C1541ROM = [[self biosDirectoryPath] stringByAppendingPathComponent:@"1541-II.355640-01.bin"];
-           if (!ROMFile::isVC1541RomFile(C1541ROM.UTF8String))
-           {
-               NSLog(@"VirtualC64: %@ is not a valid C1541 ROM!", charROM);
-               return NO;
-           }
-    }
-    
-    // Load Basic, Kernel, Char and C1541 Floppy ROMs
-    c64->loadRom([basicROM UTF8String]);
-    c64->loadRom([kernelROM UTF8String]);
-    c64->loadRom([charROM UTF8String]);
-    c64->loadRom([C1541ROM UTF8String]);
     
+    hasBootSnapshot = YES;
+    isC64Ready      = true;
+    isAtReadyPrompt = true;
     return YES;
 }
 
@@ -459,76 +581,56 @@
 
 - (void)typeText:(NSString *)text withDelay:(int)delay
 {
-    while (isStillTyping)
-        usleep(50);
+    // The delay is given in microseconds and converted to emulated frames
+    unsigned frames = (unsigned)ceil(delay * c64->vic.getFramesPerSecond() / 1000000.0);
     
-    isStillTyping = YES;
-    [_kbd typeWithString:text initialDelay:delay completion:^{
-        self->isStillTyping = NO;
-    }];
+    driver->typeText(text.lowercaseString.UTF8String, frames);
 }
 
 - (void) _loadGame:(NSString *)fileExtension
 {
     isGameLoading = true;
    
-    if (CRTFile::isCRTFile(_fileToLoad.UTF8String)) {
+    MediaType type = media->getMediaType();
+   
+    if (type == MEDIA_CARTRIDGE) {
         //Cartridge Loading
            _didRUN = true;
-          c64->expansionport.attachCartridgeAndReset( CRTFile::makeWithFile(_fileToLoad.UTF8String));
+          driver->attachCartridge(*media);
 
-    }else if (TAPFile::isTAPFile(_fileToLoad.UTF8String)) {
+    }else if (type == MEDIA_TAPE) {
         // Tape Loading
-        c64->datasette.insertTape(TAPFile::makeWithFile(_fileToLoad.UTF8String));
+        driver->insertTape(*media);
        
-        isStillTyping = YES;
-         [_kbd typeWithString:@"LOAD\n" initialDelay:0 completion:^{
-             self->isStillTyping = NO;
-             c64->datasette.pressPlay();
-         }];
+        FrameDriver *machine = driver;
+        driver->typeText("load\n", 0, [machine]() { machine->pressPlay(); });
     } else {
         //Disk Image/Archive Loading
-        auto archive = AnyArchive::makeWithFile(_fileToLoad.UTF8String);
-        if (archive != nullptr) {
-            c64->drive1.prepareToInsert();
-            c64->drive1.insertDisk(archive);
+        if (driver->autostart(*media)) {
+            // Single programs are written into memory and started right away
+            _didRUN = true;
+        } else if (driver->insertDisk(*media)) {
             [self typeText:@"load \"*\",8,1\n" withDelay:500];
         } else {
             [self typeText:@"This is an unknow image file.  C64 cannot load it." withDelay:500];
         }
     }
     
+    // The media file stays mapped, because a reset loads the game again
+    
     isGameLoading   = false;
     isGameLoaded    = true;
 }
 
 - (void) checkForReady
 {
-    int pnt = (c64->mem.peek(0x00d1) | (c64->mem.peek(0x00d2) << 8));  //Get Current Cursor position
-    int pntr = c64->mem.peek(0x00d3);     // Current column on the line
-    int lnmx = c64->mem.peek(0x00d5) + 1; // Get the line lenght
-    int blnsw = c64->mem.peek(0x00cc);    // is the curson blinking?  0 is yes, 1 in no
-    int addrStrt = pnt - lnmx;            //  set the start position in Ram to start looking at the previous line
-    char const *s = "READY.";             //  We are looking for READY.
-    bool charsFound = false;
-    
-    for (int i = 0; s[i] != '\0'; i++)
-    {
-        if (c64->mem.peek(addrStrt + i) == (s[i] % 64))
-        {
-            charsFound = true;
-        }
-        else
-        {
-            charsFound=false;
-        }
-    }
-    
-    if (charsFound)
+    // The input trap stays latched until it is consumed here. Kernals that
+    // wait for input elsewhere (JiffyDOS) are caught by polling the screen.
+    bool polled = !driver->hasStockKernal() && driver->frameCount() % 50 == 0;
+    if (driver->consumeTrap(inputTrap) || (polled && driver->readyPromptVisible()))
     {
         isAtReadyPrompt = true;
         isC64Ready      = true;
-        NSLog(@"Screen address: %d,%d, %d, %d", pnt,pntr, blnsw, lnmx);
     }
 }
 @end